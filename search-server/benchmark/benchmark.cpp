@@ -0,0 +1,603 @@
+#include "search_server.h"
+#include "document_loader.h"
+#include "durable_search_server.h"
+#include "generators.h"
+#include "process_queries.h"
+#include "request_statistics.h"
+#include "result_cursor.h"
+#include "stop_word_set.h"
+#include "term_filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <execution>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#if __has_include(<tbb/global_control.h>)
+#include <tbb/global_control.h>
+#define SEARCH_SERVER_HAS_TBB_CONTROL 1
+#endif
+
+// Prints one JSON object per line, so results can be collected and compared between builds:
+//   search_server_benchmark [--quick] > results.jsonl
+
+using namespace std;
+
+namespace
+{
+
+using Clock = chrono::steady_clock;
+
+struct BenchmarkConfig
+{
+    vector<int> corpus_sizes;
+    vector<int> query_word_counts;
+    int document_word_count;
+    int query_count;
+    int dictionary_size;
+};
+
+BenchmarkConfig MakeConfig(bool is_quick)
+{
+    if (is_quick)
+    {
+        return { { 1'000, 5'000 }, { 1, 5, 20 }, 50, 30, 2'000 };
+    }
+    return { { 1'000, 10'000, 50'000 }, { 1, 5, 20, 70 }, 70, 100, 10'000 };
+}
+
+double ToMicroseconds(Clock::duration duration)
+{
+    return chrono::duration<double, micro>(duration).count();
+}
+
+// Builds a JSON line out of string and numeric fields
+class Record
+{
+public:
+    explicit Record(string_view benchmark)
+    {
+        out_ << "{\"benchmark\":\"" << benchmark << '"';
+    }
+
+    Record& Add(string_view key, string_view value)
+    {
+        out_ << ",\"" << key << "\":\"" << value << '"';
+        return *this;
+    }
+
+    template <typename Number>
+    Record& Add(string_view key, Number value)
+    {
+        out_ << ",\"" << key << "\":" << value;
+        return *this;
+    }
+
+    // Mean and percentiles of the per-operation latencies
+    Record& AddLatencies(vector<double> latencies_us)
+    {
+        if (latencies_us.empty())
+        {
+            return *this;
+        }
+        sort(latencies_us.begin(), latencies_us.end());
+        auto percentile = [&latencies_us](double fraction)
+        {
+            return latencies_us[static_cast<size_t>(fraction * (latencies_us.size() - 1))];
+        };
+        const double total = accumulate(latencies_us.begin(), latencies_us.end(), 0.0);
+        return Add("operations", latencies_us.size())
+            .Add("mean_us", total / latencies_us.size())
+            .Add("p50_us", percentile(0.5))
+            .Add("p90_us", percentile(0.9))
+            .Add("p99_us", percentile(0.99))
+            .Add("max_us", latencies_us.back());
+    }
+
+    ~Record()
+    {
+        cout << out_.str() << '}' << endl;
+    }
+
+private:
+    ostringstream out_;
+};
+
+long GetPeakRssKb()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+vector<string> GenerateCorpus(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& word_distribution,
+    int document_count, int word_count)
+{
+    return GenerateQueries(generator, dictionary, word_distribution, document_count, word_count);
+}
+
+void FillServer(SearchServer& search_server, const vector<string>& documents)
+{
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        search_server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+}
+
+void BenchmarkAddDocument(const vector<string>& documents, const string& stop_words)
+{
+    auto search_server = make_unique<SearchServer>(stop_words);
+    auto start = Clock::now();
+    FillServer(*search_server, documents);
+    const double seconds = chrono::duration<double>(Clock::now() - start).count();
+    const IndexMemoryUsage usage = search_server->GetIndexMemoryUsage();
+
+    start = Clock::now();
+    search_server.reset();
+    const double destroy_seconds = chrono::duration<double>(Clock::now() - start).count();
+    Record("add_document")
+        .Add("corpus_size", documents.size())
+        .Add("seconds", seconds)
+        .Add("documents_per_second", documents.size() / seconds)
+        .Add("destroy_seconds", destroy_seconds)
+        .Add("dictionary_bytes", usage.dictionary_bytes)
+        .Add("posting_bytes", usage.posting_bytes)
+        .Add("forward_index_bytes", usage.forward_index_bytes)
+        .Add("reserved_bytes", usage.reserved_bytes);
+}
+
+// Membership tests of the word sets against a tree of the same words: stop words looked up
+// with the perfect hash, absent words rejected by the term filter
+void BenchmarkWordLookup(const vector<string>& dictionary, const vector<string>& words)
+{
+    const set<string, less<>> tree(dictionary.begin(), dictionary.end());
+    const StopWordSet stop_word_set(tree);
+    TermFilter term_filter(tree.size());
+    for (const string& word : tree)
+    {
+        term_filter.Add(word);
+    }
+    vector<string> absent_words;
+    for (const string& word : words)
+    {
+        absent_words.push_back(word + "#"s);
+    }
+
+    auto benchmark = [](string_view structure, string_view lookup, const vector<string>& lookup_words, auto contains)
+    {
+        const int round_count = 20;
+        size_t found_count = 0;
+        const auto start = Clock::now();
+        for (int round = 0; round < round_count; ++round)
+        {
+            for (const string& word : lookup_words)
+            {
+                found_count += contains(word);
+            }
+        }
+        const double seconds = chrono::duration<double>(Clock::now() - start).count();
+        Record("word_lookup")
+            .Add("structure", structure)
+            .Add("lookup", lookup)
+            .Add("words", lookup_words.size())
+            .Add("found", found_count / round_count)
+            .Add("ns_per_lookup", seconds * 1e9 / (lookup_words.size() * round_count));
+    };
+    auto tree_contains = [&tree](const string& word)
+    {
+        return tree.count(word) > 0;
+    };
+    benchmark("tree"sv, "present"sv, words, tree_contains);
+    benchmark("perfect_hash"sv, "present"sv, words, [&stop_word_set](const string& word)
+        {
+            return stop_word_set.Contains(word);
+        });
+    benchmark("tree"sv, "absent"sv, absent_words, tree_contains);
+    benchmark("term_filter"sv, "absent"sv, absent_words, [&term_filter](const string& word)
+        {
+            return term_filter.MayContain(word);
+        });
+}
+
+// Writes the corpus in the LoadDocuments format and streams it back through the parser pipeline
+void BenchmarkLoadDocuments(const vector<string>& documents, const string& stop_words)
+{
+    const string path = "search_server_benchmark_corpus.tsv"s;
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+            out << i << "\tACTUAL\t1 2 3\t"s << documents[i] << '\n';
+        }
+    }
+    SearchServer search_server(stop_words);
+    const LoadStatistics statistics = LoadDocuments(search_server, path);
+    remove(path.c_str());
+    Record("load_documents")
+        .Add("corpus_size", documents.size())
+        .Add("bytes", statistics.byte_count)
+        .Add("seconds", statistics.seconds)
+        .Add("documents_per_second", statistics.GetDocumentsPerSecond())
+        .Add("megabytes_per_second", statistics.GetMegabytesPerSecond());
+}
+
+// Every AddDocument waits for its log record to be synced; concurrent writers share the syncs.
+// Recovery replays the log into a fresh server.
+void BenchmarkDurableAddDocument(const vector<string>& documents, const string& stop_words)
+{
+    const int document_count = static_cast<int>(min<size_t>(documents.size(), 2000));
+    for (const int writer_count : { 1, 8 })
+    {
+        char directory_template[] = "search_server_benchmark_XXXXXX";
+        const string directory = mkdtemp(directory_template);
+        vector<double> latencies;
+        latencies.reserve(document_count);
+        WriteAheadLogStatistics log_statistics;
+        const auto start = Clock::now();
+        {
+            DurableSearchServer search_server(directory, stop_words);
+            mutex latencies_mutex;
+            vector<thread> writers;
+            for (int writer = 0; writer < writer_count; ++writer)
+            {
+                writers.emplace_back([&, writer]
+                    {
+                        vector<double> writer_latencies;
+                        for (int i = writer; i < document_count; i += writer_count)
+                        {
+                            const auto add_start = Clock::now();
+                            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+                            writer_latencies.push_back(ToMicroseconds(Clock::now() - add_start));
+                        }
+                        lock_guard lg(latencies_mutex);
+                        latencies.insert(latencies.end(), writer_latencies.begin(), writer_latencies.end());
+                    });
+            }
+            for (auto& writer : writers)
+            {
+                writer.join();
+            }
+            log_statistics = search_server.GetLogStatistics();
+        }
+        const double seconds = chrono::duration<double>(Clock::now() - start).count();
+        const DurableSearchServer recovered(directory, stop_words);
+        filesystem::remove_all(directory);
+        Record("durable_add_document")
+            .Add("writers", writer_count)
+            .Add("corpus_size", document_count)
+            .Add("documents_per_second", document_count / seconds)
+            .Add("records_per_sync", static_cast<double>(log_statistics.record_count) / max<size_t>(1, log_statistics.sync_count))
+            .Add("recovery_seconds", recovered.GetRecoveryStatistics().seconds)
+            .AddLatencies(move(latencies));
+    }
+}
+
+template <typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+void BenchmarkFindTopDocuments(string_view name, string_view policy_name, ExecutionPolicy policy, const SearchServer& search_server,
+    const vector<string>& queries, int query_word_count)
+{
+    vector<double> latencies;
+    latencies.reserve(queries.size());
+    double total_relevance = 0;
+    for (const string& query : queries)
+    {
+        const auto start = Clock::now();
+        for (const Document& document : search_server.FindTopDocuments<Scorer>(policy, query))
+        {
+            total_relevance += document.relevance;
+        }
+        latencies.push_back(ToMicroseconds(Clock::now() - start));
+    }
+    Record(name)
+        .Add("policy", policy_name)
+        .Add("corpus_size", search_server.GetDocumentCount())
+        .Add("query_words", query_word_count)
+        .Add("checksum", total_relevance)
+        .AddLatencies(move(latencies));
+}
+
+// The default FindTopDocuments(query) against the same status filter given as a lambda, which
+// takes the generic per-posting predicate path
+void BenchmarkDefaultFindTopDocuments(const SearchServer& search_server, const vector<string>& queries, int query_word_count)
+{
+    for (const bool is_lambda : { false, true })
+    {
+        vector<double> latencies;
+        latencies.reserve(queries.size());
+        double total_relevance = 0;
+        for (const string& query : queries)
+        {
+            const auto start = Clock::now();
+            const auto documents = is_lambda
+                ? search_server.FindTopDocuments(query, [](int, DocumentStatus status, int)
+                    {
+                        return status == DocumentStatus::ACTUAL;
+                    })
+                : search_server.FindTopDocuments(query);
+            latencies.push_back(ToMicroseconds(Clock::now() - start));
+            for (const Document& document : documents)
+            {
+                total_relevance += document.relevance;
+            }
+        }
+        Record("find_top_documents_default")
+            .Add("predicate", is_lambda ? "lambda"sv : "status"sv)
+            .Add("corpus_size", search_server.GetDocumentCount())
+            .Add("query_words", query_word_count)
+            .Add("checksum", total_relevance)
+            .AddLatencies(move(latencies));
+    }
+}
+
+// Deep pages served from a cursor snapshot against ranking the whole result again for every page
+void BenchmarkDeepPagination(const SearchServer& search_server, const vector<string>& queries)
+{
+    const size_t page_size = 10;
+    const size_t page_count = 20;
+    vector<double> recompute_latencies;
+    vector<double> cursor_latencies;
+    double recompute_checksum = 0;
+    double cursor_checksum = 0;
+    ResultCursorCache cache(search_server);
+    for (const string& query : queries)
+    {
+        for (size_t page_index = 1; page_index < page_count; ++page_index)
+        {
+            const auto start = Clock::now();
+            const auto documents = search_server.FindRankedDocuments(execution::seq, query, DocumentStatus::ACTUAL);
+            for (size_t i = page_index * page_size; i < min(documents.size(), (page_index + 1) * page_size); ++i)
+            {
+                recompute_checksum += documents[i].relevance;
+            }
+            recompute_latencies.push_back(ToMicroseconds(Clock::now() - start));
+        }
+        const ResultPage first_page = cache.FindFirstPage(execution::seq, query, page_size);
+        if (!first_page.next_cursor)
+        {
+            continue;
+        }
+        for (size_t page_index = 1; page_index < page_count; ++page_index)
+        {
+            const auto start = Clock::now();
+            ResultCursor cursor = *first_page.next_cursor;
+            cursor.offset = page_index * page_size;
+            for (const Document& document : cache.GetPage(cursor).documents)
+            {
+                cursor_checksum += document.relevance;
+            }
+            cursor_latencies.push_back(ToMicroseconds(Clock::now() - start));
+        }
+        cache.Close(first_page.next_cursor->snapshot_id);
+    }
+    Record("deep_pagination")
+        .Add("method", "recompute"sv)
+        .Add("corpus_size", search_server.GetDocumentCount())
+        .Add("page_size", page_size)
+        .Add("checksum", recompute_checksum)
+        .AddLatencies(move(recompute_latencies));
+    Record("deep_pagination")
+        .Add("method", "cursor"sv)
+        .Add("corpus_size", search_server.GetDocumentCount())
+        .Add("page_size", page_size)
+        .Add("checksum", cursor_checksum)
+        .AddLatencies(move(cursor_latencies));
+}
+
+template <typename ExecutionPolicy>
+void BenchmarkMatchDocument(string_view policy_name, ExecutionPolicy policy, const SearchServer& search_server,
+    const vector<string>& queries, int query_word_count)
+{
+    vector<double> latencies;
+    size_t matched_word_count = 0;
+    const int document_count = search_server.GetDocumentCount();
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        const int document_id = static_cast<int>(i * 7919 % document_count);
+        const auto start = Clock::now();
+        const auto [words, status] = search_server.MatchDocument(policy, queries[i], document_id);
+        latencies.push_back(ToMicroseconds(Clock::now() - start));
+        matched_word_count += words.size();
+    }
+    Record("match_document")
+        .Add("policy", policy_name)
+        .Add("corpus_size", document_count)
+        .Add("query_words", query_word_count)
+        .Add("checksum", matched_word_count)
+        .AddLatencies(move(latencies));
+}
+
+// Removes and re-adds every other document, as an index with steady updates does
+void BenchmarkRemoveDocument(SearchServer& search_server, const vector<string>& documents)
+{
+    vector<double> remove_latencies;
+    vector<double> add_latencies;
+    for (size_t i = 0; i < documents.size(); i += 2)
+    {
+        const int document_id = static_cast<int>(i);
+        auto start = Clock::now();
+        search_server.RemoveDocument(document_id);
+        remove_latencies.push_back(ToMicroseconds(Clock::now() - start));
+
+        start = Clock::now();
+        search_server.AddDocument(document_id, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        add_latencies.push_back(ToMicroseconds(Clock::now() - start));
+    }
+    Record("remove_document_churn")
+        .Add("operation", "remove"sv)
+        .Add("corpus_size", documents.size())
+        .AddLatencies(move(remove_latencies));
+    Record("remove_document_churn")
+        .Add("operation", "add"sv)
+        .Add("corpus_size", documents.size())
+        .AddLatencies(move(add_latencies));
+
+    const IndexMemoryUsage churned_usage = search_server.GetIndexMemoryUsage();
+    const auto start = Clock::now();
+    search_server.Compact();
+    const double seconds = chrono::duration<double>(Clock::now() - start).count();
+    const IndexMemoryUsage compacted_usage = search_server.GetIndexMemoryUsage();
+    Record("compact")
+        .Add("corpus_size", documents.size())
+        .Add("seconds", seconds)
+        .Add("reserved_bytes_before", churned_usage.reserved_bytes)
+        .Add("reserved_bytes_after", compacted_usage.reserved_bytes)
+        .Add("average_posting_length", compacted_usage.GetAveragePostingLength());
+}
+
+void BenchmarkProcessQueries(const SearchServer& search_server, const vector<string>& queries)
+{
+    const unsigned max_thread_count = max(1u, thread::hardware_concurrency());
+    for (unsigned thread_count = 1; thread_count <= max_thread_count; thread_count *= 2)
+    {
+#ifdef SEARCH_SERVER_HAS_TBB_CONTROL
+        tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, thread_count);
+#endif
+        const auto start = Clock::now();
+        const auto results = ProcessQueries(search_server, queries);
+        const double seconds = chrono::duration<double>(Clock::now() - start).count();
+        Record("process_queries")
+#ifdef SEARCH_SERVER_HAS_TBB_CONTROL
+            .Add("threads", thread_count)
+#else
+            .Add("threads", "backend_default"sv)
+#endif
+            .Add("corpus_size", search_server.GetDocumentCount())
+            .Add("queries", queries.size())
+            .Add("seconds", seconds)
+            .Add("queries_per_second", queries.size() / seconds);
+#ifndef SEARCH_SERVER_HAS_TBB_CONTROL
+        break;
+#endif
+    }
+}
+
+// Same queries on the server's own pool, pinned, with the pool's steal statistics
+void BenchmarkProcessQueriesOnPool(SearchServer& search_server, const vector<string>& queries)
+{
+    const unsigned max_thread_count = max(1u, thread::hardware_concurrency());
+    for (unsigned thread_count = 1; thread_count <= max_thread_count; thread_count *= 2)
+    {
+        search_server.SetThreadPoolOptions({ thread_count, true });
+        const auto start = Clock::now();
+        const auto results = ProcessQueries(thread_pool_policy, search_server, queries);
+        const double seconds = chrono::duration<double>(Clock::now() - start).count();
+        const ThreadPoolStatistics statistics = search_server.GetThreadPool().GetStatistics();
+        Record("process_queries_pool")
+            .Add("threads", thread_count)
+            .Add("corpus_size", search_server.GetDocumentCount())
+            .Add("queries", queries.size())
+            .Add("seconds", seconds)
+            .Add("queries_per_second", queries.size() / seconds)
+            .Add("tasks", statistics.task_count)
+            .Add("stolen_tasks", statistics.stolen_task_count)
+            .Add("max_queue_depth", statistics.max_queue_depth);
+    }
+}
+
+
+// Query threads recording into the same time slots at once
+void BenchmarkRequestStatistics()
+{
+    const int record_count = 1000000;
+    const unsigned max_thread_count = max(1u, thread::hardware_concurrency());
+    for (unsigned thread_count = 1; thread_count <= max_thread_count; thread_count *= 2)
+    {
+        auto statistics = make_unique<RequestStatistics>();
+        vector<thread> threads;
+        const auto start = Clock::now();
+        for (unsigned t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back([&statistics, thread_count]
+                {
+                    for (unsigned i = 0; i < record_count / thread_count; ++i)
+                    {
+                        statistics->Record(Clock::now(), i % 2 == 0, chrono::microseconds(1));
+                    }
+                });
+        }
+        for (thread& worker : threads)
+        {
+            worker.join();
+        }
+        const double seconds = chrono::duration<double>(Clock::now() - start).count();
+        const RequestWindowStatistics window = statistics->GetStatistics(chrono::hours(1), Clock::now());
+        Record("request_statistics_record")
+            .Add("threads", thread_count)
+            .Add("records", window.request_count)
+            .Add("records_per_second", window.request_count / seconds);
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const bool is_quick = argc > 1 && strcmp(argv[1], "--quick") == 0;
+    const BenchmarkConfig config = MakeConfig(is_quick);
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, config.dictionary_size, 10);
+    const ZipfDistribution word_distribution(dictionary.size(), 1.0);
+    // The most frequent words are the stop words, like in natural text
+    const string stop_words = dictionary[0] + " "s + dictionary[1] + " "s + dictionary[2];
+
+    BenchmarkWordLookup(dictionary, GenerateQueries(generator, dictionary, 10000, 1));
+    BenchmarkRequestStatistics();
+
+    for (int corpus_size : config.corpus_sizes)
+    {
+        const auto documents = GenerateCorpus(generator, dictionary, word_distribution, corpus_size, config.document_word_count);
+        BenchmarkAddDocument(documents, stop_words);
+        BenchmarkLoadDocuments(documents, stop_words);
+        BenchmarkDurableAddDocument(documents, stop_words);
+
+        SearchServer search_server(stop_words);
+        FillServer(search_server, documents);
+
+        for (int query_word_count : config.query_word_counts)
+        {
+            const auto queries = GenerateQueries(generator, dictionary, word_distribution, config.query_count, query_word_count);
+            BenchmarkFindTopDocuments("find_top_documents", "seq", execution::seq, search_server, queries, query_word_count);
+            BenchmarkFindTopDocuments("find_top_documents", "par", execution::par, search_server, queries, query_word_count);
+            BenchmarkFindTopDocuments("find_top_documents", "pool", thread_pool_policy, search_server, queries, query_word_count);
+            BenchmarkFindTopDocuments<Bm25Scorer>("find_top_documents_bm25", "seq", execution::seq, search_server, queries, query_word_count);
+            BenchmarkDefaultFindTopDocuments(search_server, queries, query_word_count);
+        }
+        BenchmarkDeepPagination(search_server, GenerateQueries(generator, dictionary, word_distribution, config.query_count, 3));
+
+        const int minus_query_word_count = 20;
+        const auto minus_queries = GenerateQueries(generator, dictionary, word_distribution, config.query_count,
+            minus_query_word_count, 0.5);
+        BenchmarkFindTopDocuments("find_top_documents_minus_words", "seq", execution::seq, search_server, minus_queries, minus_query_word_count);
+        BenchmarkFindTopDocuments("find_top_documents_minus_words", "par", execution::par, search_server, minus_queries, minus_query_word_count);
+
+        const int match_query_word_count = 20;
+        const auto match_queries = GenerateQueries(generator, dictionary, word_distribution, config.query_count * 10,
+            match_query_word_count, 0.1);
+        BenchmarkMatchDocument("seq", execution::seq, search_server, match_queries, match_query_word_count);
+        BenchmarkMatchDocument("par", execution::par, search_server, match_queries, match_query_word_count);
+
+        const auto process_queries = GenerateQueries(generator, dictionary, word_distribution, config.query_count * 10, 10);
+        BenchmarkProcessQueries(search_server, process_queries);
+        BenchmarkProcessQueriesOnPool(search_server, process_queries);
+        BenchmarkRemoveDocument(search_server, documents);
+    }
+
+    Record("peak_rss").Add("kilobytes", GetPeakRssKb());
+}
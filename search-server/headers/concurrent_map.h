@@ -1,3 +1,5 @@
+#pragma once
+
 #include <algorithm>
 #include <cstdlib>
 #include <future>
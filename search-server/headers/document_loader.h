@@ -0,0 +1,41 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <iostream>
+#include <string>
+
+// Corpus files have one document per line:
+//   id<TAB>status<TAB>ratings<TAB>text
+// status is ACTUAL, IRRELEVANT, BANNED or REMOVED, ratings are space separated integers and may be empty.
+
+struct LoadOptions
+{
+    // Threads splitting lines into fields and words while the calling thread indexes them
+    size_t parser_thread_count = 2;
+    // Size of the file piece parsed as one batch
+    size_t batch_bytes = 1 << 20;
+    // Parsers wait while this many parsed batches are waiting for the indexer
+    size_t max_queued_batch_count = 4;
+    // Parses on the server's thread pool instead of parser threads of its own; parser_thread_count is
+    // then ignored and max_queued_batch_count more batches than pool threads are parsed ahead
+    bool use_thread_pool = false;
+};
+
+struct LoadStatistics
+{
+    size_t document_count = 0;
+    // Malformed lines and documents the server refused
+    size_t rejected_line_count = 0;
+    size_t byte_count = 0;
+    double seconds = 0;
+
+    double GetDocumentsPerSecond() const;
+    double GetMegabytesPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const LoadStatistics& statistics);
+
+// Streams the file into the server through a memory map. Besides the index, memory holds at most
+// max_queued_batch_count + parser_thread_count parsed batches, whatever the file size.
+LoadStatistics LoadDocuments(SearchServer& search_server, const std::string& path, const LoadOptions& options = {});
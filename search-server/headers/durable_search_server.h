@@ -0,0 +1,80 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+
+struct RecoveryStatistics
+{
+    size_t snapshot_record_count = 0;
+    size_t log_record_count = 0;
+    // Documents indexed by the replay; documents removed later in the log are never indexed
+    size_t document_count = 0;
+    // Torn or damaged tail cut off the log
+    size_t discarded_byte_count = 0;
+    double seconds = 0;
+};
+
+// SearchServer whose changes survive a crash. AddDocument and RemoveDocument append the change to
+// a write-ahead log and apply it once the record is on disk, so readers never see a change a crash
+// would lose; concurrent writers share fsync calls. A change whose record can not be written is
+// not applied, and once the log fails every later change throws. Checkpoint freezes the log, starts
+// an empty one and compacts the live documents of the snapshot and the frozen log into a new
+// snapshot. The constructor recovers the index from the snapshot and the logs found in the directory.
+class DurableSearchServer
+{
+public:
+    DurableSearchServer(const std::string& directory, std::string_view stop_words_text);
+
+    DurableSearchServer(const DurableSearchServer&) = delete;
+    DurableSearchServer& operator=(const DurableSearchServer&) = delete;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    // Holds off readers and writers only while the log is switched, not while the snapshot is written
+    void Checkpoint();
+
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    int GetDocumentCount() const;
+    const RecoveryStatistics& GetRecoveryStatistics() const;
+    WriteAheadLogStatistics GetLogStatistics() const;
+
+private:
+    std::string directory_;
+    SearchServer server_;
+    mutable std::shared_mutex mut_;
+    // One checkpoint at a time, the frozen log of the last one must be gone before the log is frozen
+    std::mutex checkpoint_mut_;
+    // Writers keep the log alive while they wait, Checkpoint may replace it meanwhile
+    std::shared_ptr<WriteAheadLog> log_;
+    // Documents whose change is waiting for its record to be durable. Other writers leave them
+    // alone, so the index applies the changes of a document in the order of the log.
+    std::unordered_set<int> pending_document_ids_;
+    RecoveryStatistics recovery_statistics_;
+
+    std::string GetSnapshotPath() const;
+    std::string GetLogPath() const;
+    // Log frozen by a checkpoint until the snapshot includes it
+    std::string GetFrozenLogPath() const;
+    void Recover();
+    // Writes the live documents of the snapshot and the frozen log as the new snapshot
+    void CompactSnapshot();
+    // Called with the lock held; the lock is released while the record is synced
+    template <typename AppendRecord, typename ApplyChange>
+    void LogAndApply(std::unique_lock<std::shared_mutex>& lock, int document_id, AppendRecord append_record, ApplyChange apply_change);
+};
+
+template <typename... Args>
+std::vector<Document> DurableSearchServer::FindTopDocuments(Args&&... args) const
+{
+    std::shared_lock lock(mut_);
+    return server_.FindTopDocuments(std::forward<Args>(args)...);
+}
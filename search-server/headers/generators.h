@@ -0,0 +1,29 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Picks dictionary indexes with probability proportional to 1 / (index + 1)^exponent,
+// which is how term frequencies of natural text are distributed
+class ZipfDistribution
+{
+public:
+    ZipfDistribution(size_t size, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    std::vector<double> cumulative_weights_;
+};
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& word_distribution,
+    int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, const ZipfDistribution& word_distribution,
+    int query_count, int max_word_count, double minus_prob = 0);
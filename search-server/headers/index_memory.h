@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Counts the bytes currently allocated through it; the memory comes from the upstream resource
+class CountingMemoryResource : public std::pmr::memory_resource
+{
+public:
+    explicit CountingMemoryResource(std::pmr::memory_resource* upstream);
+
+    size_t GetAllocatedBytes() const;
+
+private:
+    std::pmr::memory_resource* upstream_;
+    size_t allocated_bytes_ = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Allocates from a memory resource like std::pmr::polymorphic_allocator, but does not hand itself
+// down to the elements, so a map and the maps nested in it can use different resources
+template <typename T>
+class IndexAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    IndexAllocator(std::pmr::memory_resource* resource)
+        : resource_(resource)
+    {
+    }
+
+    template <typename U>
+    IndexAllocator(const IndexAllocator<U>& other)
+        : resource_(other.GetResource())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    std::pmr::memory_resource* GetResource() const
+    {
+        return resource_;
+    }
+
+private:
+    std::pmr::memory_resource* resource_;
+};
+
+template <typename T, typename U>
+bool operator==(const IndexAllocator<T>& lhs, const IndexAllocator<U>& rhs)
+{
+    return lhs.GetResource() == rhs.GetResource();
+}
+
+template <typename T, typename U>
+bool operator!=(const IndexAllocator<T>& lhs, const IndexAllocator<U>& rhs)
+{
+    return !(lhs == rhs);
+}
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+using IndexMap = std::map<Key, Value, Compare, IndexAllocator<std::pair<const Key, Value>>>;
+template <typename Key>
+using IndexSet = std::set<Key, std::less<Key>, IndexAllocator<Key>>;
+template <typename T>
+using IndexVector = std::vector<T, IndexAllocator<T>>;
+using IndexString = std::basic_string<char, std::char_traits<char>, IndexAllocator<char>>;
+
+// Memory of one SearchServer index: a pool and an account over it for every structure
+struct IndexMemory
+{
+    CountingMemoryResource reserved{ std::pmr::new_delete_resource() };
+    std::pmr::unsynchronized_pool_resource pool{ &reserved };
+    CountingMemoryResource dictionary{ &pool };
+    CountingMemoryResource postings{ &pool };
+    CountingMemoryResource positions{ &pool };
+    CountingMemoryResource forward_index{ &pool };
+    CountingMemoryResource documents{ &pool };
+};
+
+// Memory taken by the parts of a SearchServer and what they hold
+struct IndexMemoryUsage
+{
+    // The map from term ids to posting lists
+    size_t dictionary_bytes = 0;
+    // Posting lists of word_to_document_freqs_
+    size_t posting_bytes = 0;
+    // word_to_document_positions_, empty unless the positional index is enabled
+    size_t position_bytes = 0;
+    // document_to_word_freqs_
+    size_t forward_index_bytes = 0;
+    // documents_ and the document ids
+    size_t document_bytes = 0;
+    // Estimated, the stop words live outside the pool
+    size_t stop_word_bytes = 0;
+    // The indexed words, their ids and the sorted order for prefix queries
+    size_t term_dictionary_bytes = 0;
+    // Bloom filter over the indexed words
+    size_t term_filter_bytes = 0;
+    // Taken from the system by the pool, including the blocks freed by removed documents
+    size_t reserved_bytes = 0;
+
+    size_t term_count = 0;
+    size_t posting_count = 0;
+    size_t document_count = 0;
+
+    double GetAveragePostingLength() const;
+    // Reserved by the pool but not used; Compact returns them to the system
+    size_t GetFreeBytes() const;
+};
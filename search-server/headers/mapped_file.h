@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only mapping of a whole file, advised for sequential access
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const
+    {
+        return data_;
+    }
+
+    std::size_t GetSize() const
+    {
+        return size_;
+    }
+
+    // Drops the pages lying entirely inside the range; they are read from the file again if touched
+    void Release(const char* begin, const char* end) const;
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
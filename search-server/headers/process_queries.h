@@ -1,6 +1,7 @@
 #pragma once
 
 #include "document.h"
+#include "thread_pool.h"
 //#include "search_server.h"
 
 #include <vector>
@@ -17,5 +18,9 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Runs the queries, and the id ranges of every query, on the server's thread pool
+std::vector<std::vector<Document>> ProcessQueries(ThreadPoolPolicy, const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
 
 std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
\ No newline at end of file
@@ -1,67 +1,54 @@
 #pragma once
 
-#include <deque>
 #include "search_server.h"
+#include "request_statistics.h"
 #include "paginator.h"
 
 
-class RequestQueue 
+// Runs search requests and keeps statistics of them over time windows. Requests may be added
+// from many threads at once, as long as the server is not changed meanwhile.
+class RequestQueue
 {
 public:
     explicit RequestQueue(const SearchServer& search_server);
-    
+
     template <typename Ex_Pol, typename DocumentPredicate>
     std::vector<Document> AddFindRequest(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate);
-    
+
     template <typename Ex_Pol>
     std::vector<Document> AddFindRequest(Ex_Pol ep, std::string_view raw_query, DocumentStatus status);
 
     template <typename Ex_Pol>
     std::vector<Document> AddFindRequest(Ex_Pol ep, std::string_view raw_query);
+
+    // Requests of the last day that found nothing
     int GetNoResultRequests() const;
+    // Requests of the last window, which may be up to a day long
+    RequestWindowStatistics GetStatistics(RequestStatistics::Clock::duration window) const;
 
 private:
-    struct QueryResult 
-    {
-        bool is_empty;
-    };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
     const SearchServer& search_server_;
-    size_t number_of_no_result_requests_ = 0;
+    RequestStatistics statistics_;
 };
 
 template <typename Ex_Pol>
 std::vector<Document> RequestQueue::AddFindRequest(Ex_Pol ep, std::string_view raw_query, DocumentStatus status)
 {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating)
-        {
-            return document_status == status;
-        });
+    return AddFindRequest(ep, raw_query, DocumentStatusPredicate{ status });
 }
 
 template <typename Ex_Pol>
 std::vector<Document> RequestQueue::AddFindRequest(Ex_Pol ep, std::string_view raw_query)
 {
-    return AddFindRequest(raw_query, [](int document_id, DocumentStatus document_status, int rating)
-        {
-            return document_status == DocumentStatus::ACTUAL;
-        });
+    return AddFindRequest(ep, raw_query, DocumentStatus::ACTUAL);
 }
 
 template <typename Ex_Pol, typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate)
 {
-    std::vector<Document> res = search_server_.FindTopDocuments(raw_query, document_predicate);
-    if (requests_.size() >= min_in_day_)
-    {
-        if (requests_.front().is_empty && !res.empty())
-        {
-            --number_of_no_result_requests_;
-        }
-        requests_.pop_front();
-    }
-    number_of_no_result_requests_ += res.empty();
-    requests_.push_back({ res.empty() });
+    const auto start = RequestStatistics::Clock::now();
+    std::vector<Document> res = search_server_.FindTopDocuments(ep, raw_query, document_predicate);
+    const auto finish = RequestStatistics::Clock::now();
+    statistics_.Record(finish, res.empty(), finish - start);
     return res;
 }
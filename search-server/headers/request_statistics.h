@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct RequestWindowStatistics
+{
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    std::chrono::nanoseconds latency_sum{ 0 };
+
+    std::chrono::nanoseconds GetAverageLatency() const;
+};
+
+// Request counts of every second of the last five minutes and every minute of the last day, kept
+// in two rings of time slots. A slot is claimed for a new second or minute with a compare and
+// swap and counted into with atomic additions, so any number of threads record at once without
+// a lock. Counts read while requests are recorded may miss the requests of the last moment.
+class RequestStatistics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t SECOND_SLOT_COUNT = 300;
+    static constexpr size_t MINUTE_SLOT_COUNT = 1440;
+
+    void Record(Clock::time_point time, bool is_empty, Clock::duration latency);
+
+    // Requests of the window ending at time. Windows up to SECOND_SLOT_COUNT seconds are counted
+    // by seconds, longer ones by minutes, both rounded up. Throws invalid_argument for windows
+    // that are not positive or longer than a day.
+    RequestWindowStatistics GetStatistics(Clock::duration window, Clock::time_point time) const;
+
+private:
+    // Set in the tick of a slot while its counters are being cleared for the tick
+    static constexpr uint64_t RESETTING_TICK_FLAG = uint64_t(1) << 63;
+    static constexpr uint64_t EMPTY_TICK = RESETTING_TICK_FLAG - 1;
+
+    struct Slot
+    {
+        // Second or minute the counters are for
+        std::atomic<uint64_t> tick{ EMPTY_TICK };
+        std::atomic<uint64_t> request_count{ 0 };
+        std::atomic<uint64_t> no_result_count{ 0 };
+        std::atomic<uint64_t> latency_sum_ns{ 0 };
+    };
+
+    std::array<Slot, SECOND_SLOT_COUNT> second_slots_;
+    std::array<Slot, MINUTE_SLOT_COUNT> minute_slots_;
+
+    static void RecordSlot(Slot& slot, uint64_t tick, bool is_empty, uint64_t latency_ns);
+    static void AddSlot(const Slot& slot, uint64_t tick, RequestWindowStatistics& statistics);
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+struct ResultCursorOptions
+{
+    // A snapshot not read for this long is dropped
+    std::chrono::steady_clock::duration ttl = std::chrono::minutes(5);
+    // Bytes all snapshots may take together; the least recently read ones are dropped to stay below it
+    size_t memory_budget = size_t(64) << 20;
+};
+
+// Position in a ranked result kept by ResultCursorCache. Any offset may be asked for, so page N
+// of a result is the cursor with offset N * page_size.
+struct ResultCursor
+{
+    uint64_t snapshot_id = 0;
+    size_t offset = 0;
+    size_t page_size = 0;
+};
+
+struct ResultPage
+{
+    std::vector<Document> documents;
+    // Documents in the whole snapshot
+    size_t document_count = 0;
+    // Empty after the last page
+    std::optional<ResultCursor> next_cursor;
+};
+
+struct ResultCursorStatistics
+{
+    size_t snapshot_count = 0;
+    size_t byte_count = 0;
+    // Dropped because their TTL ran out or the index changed
+    size_t expired_snapshot_count = 0;
+    // Dropped to stay within the memory budget
+    size_t evicted_snapshot_count = 0;
+};
+
+// Serves a ranked result page by page. The first page ranks every matching document once and keeps
+// them as a snapshot tied to the index generation; any later page is copied out of the snapshot
+// in O(page size). Safe to call from many threads, as long as the server is not changed meanwhile.
+class ResultCursorCache
+{
+public:
+    explicit ResultCursorCache(const SearchServer& search_server, const ResultCursorOptions& options = {});
+
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol, typename DocumentPredicate>
+    ResultPage FindFirstPage(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate, size_t page_size);
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
+    ResultPage FindFirstPage(Ex_Pol ep, std::string_view raw_query, DocumentStatus status, size_t page_size);
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
+    ResultPage FindFirstPage(Ex_Pol ep, std::string_view raw_query, size_t page_size);
+
+    // Throws out_of_range if the snapshot has expired, has been evicted or the index has changed
+    // since it was taken; the query has to be run again then
+    ResultPage GetPage(const ResultCursor& cursor);
+
+    // Frees the snapshot before its TTL runs out
+    void Close(uint64_t snapshot_id);
+
+    ResultCursorStatistics GetStatistics() const;
+
+private:
+    // Two thirds of a Document
+    struct RankedDocument
+    {
+        int id;
+        int rating;
+        double relevance;
+    };
+
+    struct Snapshot
+    {
+        uint64_t id;
+        uint64_t index_generation;
+        std::chrono::steady_clock::time_point last_read_time;
+        std::vector<RankedDocument> documents;
+    };
+
+    using SnapshotList = std::list<Snapshot>;
+
+    const SearchServer& search_server_;
+    const ResultCursorOptions options_;
+    mutable std::mutex mut_;
+    // Most recently read first
+    SnapshotList snapshots_;
+    std::unordered_map<uint64_t, SnapshotList::iterator> snapshot_by_id_;
+    uint64_t next_snapshot_id_ = 1;
+    ResultCursorStatistics statistics_;
+
+    static size_t GetSnapshotSize(const Snapshot& snapshot);
+
+    ResultPage AddSnapshot(const std::vector<Document>& documents, uint64_t index_generation, size_t page_size);
+    static ResultPage MakePage(const Snapshot& snapshot, size_t offset, size_t page_size);
+    void DropSnapshot(SnapshotList::iterator it);
+    void DropExpiredSnapshots(std::chrono::steady_clock::time_point now);
+};
+
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate>
+ResultPage ResultCursorCache::FindFirstPage(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate, size_t page_size)
+{
+    if (page_size == 0)
+    {
+        throw std::invalid_argument("Page size must be positive");
+    }
+    // Ranking runs outside the lock, other cursors are served meanwhile
+    const uint64_t index_generation = search_server_.GetIndexGeneration();
+    return AddSnapshot(search_server_.FindRankedDocuments<Scorer>(ep, raw_query, document_predicate), index_generation, page_size);
+}
+
+template <typename Scorer, typename Ex_Pol>
+ResultPage ResultCursorCache::FindFirstPage(Ex_Pol ep, std::string_view raw_query, DocumentStatus status, size_t page_size)
+{
+    return FindFirstPage<Scorer>(ep, raw_query, DocumentStatusPredicate{ status }, page_size);
+}
+
+template <typename Scorer, typename Ex_Pol>
+ResultPage ResultCursorCache::FindFirstPage(Ex_Pol ep, std::string_view raw_query, size_t page_size)
+{
+    return FindFirstPage<Scorer>(ep, raw_query, DocumentStatus::ACTUAL, page_size);
+}
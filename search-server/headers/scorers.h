@@ -0,0 +1,76 @@
+#pragma once
+
+// Scoring models for SearchServer::FindTopDocuments, chosen at compile time:
+//   search_server.FindTopDocuments<Bm25Scorer>(std::execution::par, raw_query);
+// A scorer is built once per query from the corpus statistics. GetTermWeight is called once per
+// query word, Score once per posting, so Score must stay a few arithmetic operations; postings
+// carry the inverse document length, so it costs no lookup. Term frequencies come normalized by
+// the document length and inverse document frequencies as log(document_count / document_freq),
+// so ranking over several indexes keeps working.
+
+struct CorpusStatistics
+{
+    int document_count = 0;
+    // In words, stop words excluded
+    double average_document_length = 0;
+};
+
+class TfIdfScorer
+{
+public:
+    explicit TfIdfScorer(const CorpusStatistics&)
+    {
+    }
+
+    double GetTermWeight(double inverse_document_freq) const
+    {
+        return inverse_document_freq;
+    }
+
+    double Score(double term_weight, double term_freq, double /*inv_document_length*/) const
+    {
+        return term_weight * term_freq;
+    }
+
+    // No document gets more than this for the word, since the term frequency is at most 1
+    double GetUpperBound(double term_weight) const
+    {
+        return term_weight;
+    }
+};
+
+// Okapi BM25. With the term frequency already divided by the document length, the usual
+// count / (count + K1 * (1 - B + B * length / average_length)) becomes
+// term_freq / (term_freq + K1 * (1 - B) / length + K1 * B / average_length),
+// so a posting costs one multiply-add and one division over TF-IDF.
+class Bm25Scorer
+{
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    explicit Bm25Scorer(const CorpusStatistics& statistics)
+        : length_norm_(statistics.average_document_length > 0 ? K1 * B / statistics.average_document_length : 0)
+    {
+    }
+
+    double GetTermWeight(double inverse_document_freq) const
+    {
+        return inverse_document_freq * (K1 + 1);
+    }
+
+    double Score(double term_weight, double term_freq, double inv_document_length) const
+    {
+        return term_weight * term_freq / (term_freq + SHORT_DOCUMENT_NORM * inv_document_length + length_norm_);
+    }
+
+    double GetUpperBound(double term_weight) const
+    {
+        return term_weight / (1 + length_norm_);
+    }
+
+private:
+    static constexpr double SHORT_DOCUMENT_NORM = K1 * (1 - B);
+
+    double length_norm_;
+};
@@ -9,51 +9,183 @@
 #include <utility>
 #include <stdexcept>
 #include <execution>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <thread>
+#include <limits>
 
 #include "read_input_functions.h"
 #include "process_queries.h"
 #include "log_duration.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
 #include "document.h"
+#include "term_dictionary.h"
+#include "term_filter.h"
+#include "stop_word_set.h"
+#include "scorers.h"
+#include "index_memory.h"
+#include "thread_pool.h"
 
 extern int MAX_RESULT_DOCUMENT_COUNT;
 extern double EPSILON;
+// How many dictionary words a prefix query word such as cat* expands to at most
+extern int MAX_PREFIX_EXPANSION_COUNT;
+// Parallel queries split the document ids into ranges scored independently: at least this many
+// documents per range, and several ranges per thread so that busy threads steal from each other
+extern int MIN_QUERY_RANGE_DOCUMENT_COUNT;
+extern int QUERY_RANGES_PER_THREAD;
+
+// Predicates FindTopDocuments recognizes at compile time: they are checked once per matched
+// document instead of once per posting
+struct DocumentStatusPredicate
+{
+    DocumentStatus status;
+
+    bool operator()(int /*document_id*/, DocumentStatus document_status, int /*rating*/) const
+    {
+        return document_status == status;
+    }
+};
+
+struct AcceptAllPredicate
+{
+    bool operator()(int /*document_id*/, DocumentStatus /*status*/, int /*rating*/) const
+    {
+        return true;
+    }
+};
+
+// Counts over the documents matching a query, computed in the pass that ranks them
+struct FacetCounts
+{
+    // All documents matching the query words whatever the filter, so a UI can show how many
+    // results every status would give
+    std::map<DocumentStatus, int> status_counts;
+    // Rating of the documents passing the filter
+    std::map<int, int> rating_counts;
+
+    void Merge(const FacetCounts& other);
+};
+
+struct FacetedSearchResult
+{
+    std::vector<Document> documents;
+    FacetCounts facets;
+};
+
+// Words every prefix query word expands to, keyed by the prefix without its *
+using PrefixExpansions = std::map<std::string_view, std::vector<std::string_view>>;
+
+// Statistics of the words a query ranks by in one index. Those of several indexes are merged, so
+// that all of them rank with global document frequencies and the same prefix expansions.
+struct QueryTermStatistics
+{
+    int document_count = 0;
+    // Plus words of the query, prefix words expanded
+    std::map<std::string_view, int> word_document_counts;
+    // In dictionary order, at most MAX_PREFIX_EXPANSION_COUNT words each
+    PrefixExpansions prefix_expansions;
+
+    // Expansions keep the first words of both, which are the first ones of the merged dictionary
+    void Merge(const QueryTermStatistics& other);
+    std::map<std::string_view, double> ComputeInverseDocumentFreqs() const;
+};
 
 class SearchServer
 {
 public:
+    // The words view the dictionary and stay valid while they are indexed
+    using WordFrequencies = std::map<std::string_view, double>;
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(const std::string& stop_words_text);
     explicit SearchServer(std::string_view stop_words_text);
+    ~SearchServer();
+
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+
+    // Keeps word positions so that "quoted phrases" can be searched; must be called before documents are added
+    void EnablePositionalIndex();
 
     //void AddDocument(int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings);
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Takes the words already split by SplitIntoWordsNoStop, e.g. on a parser thread
+    void AddDocument(int document_id, std::string_view document, const std::vector<std::string_view>& words,
+        DocumentStatus status, const std::vector<int>& ratings);
+
+    // Safe to call concurrently with any other method, it reads only the stop words
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
     //    template <typename DocumentPredicate>
     //    std::vector<Document> FindTopDocuments(const std::string& raw_query, DocumentPredicate document_predicate) const;
     //    std::vector<Document> FindTopDocuments(const std::string& raw_query, DocumentStatus status) const;
     //    std::vector<Document> FindTopDocuments(const std::string& raw_query) const;
 
-    template <typename DocumentPredicate>
+    // Scorer is a scoring model from scorers.h, TF-IDF unless given explicitly
+    template <typename Scorer = TfIdfScorer, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+    template <typename Scorer>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    template <typename Scorer>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
-    template <typename Ex_Pol, typename DocumentPredicate>
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const;
-    template <typename Ex_Pol>
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
     std::vector<Document> FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const;
-    template <typename Ex_Pol>
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
     std::vector<Document> FindTopDocuments(Ex_Pol ep, std::string_view raw_query) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Ranks with statistics of several indexes, e.g. merged QueryTermStatistics: IDF values are supplied
+    // externally and prefix words expand to the given words instead of those of this dictionary
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol, typename DocumentPredicate, typename InverseDocumentFreq>
+    std::vector<Document> FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate,
+        InverseDocumentFreq inverse_document_freq, const PrefixExpansions& prefix_expansions) const;
+
+    // Top documents together with the facet counts of all matching documents
+    FacetedSearchResult FindTopDocumentsWithFacets(std::string_view raw_query, DocumentStatus status) const;
+    FacetedSearchResult FindTopDocumentsWithFacets(std::string_view raw_query) const;
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol, typename DocumentPredicate>
+    FacetedSearchResult FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
+    FacetedSearchResult FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const;
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
+    FacetedSearchResult FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query) const;
+
+    // Every matching document in rank order, not cut to MAX_RESULT_DOCUMENT_COUNT; used to page deep
+    // into a result
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol, typename DocumentPredicate>
+    std::vector<Document> FindRankedDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename Scorer = TfIdfScorer, typename Ex_Pol>
+    std::vector<Document> FindRankedDocuments(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const;
+
+    int GetWordDocumentCount(std::string_view word) const;
+    // The words view the query or the index
+    QueryTermStatistics GetQueryTermStatistics(std::string_view raw_query) const;
+
+    WordFrequencies GetWordFrequencies(int document_id) const;
 
     int GetDocumentCount() const;
+    int GetDocumentCount(DocumentStatus status) const;
+    bool HasDocument(int document_id) const;
+
+    CorpusStatistics GetCorpusStatistics() const;
+
+    // Changes whenever a document is added or removed, so results computed earlier can be told stale
+    uint64_t GetIndexGeneration() const;
 
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    IndexSet<int>::const_iterator begin() const;
+    IndexSet<int>::const_iterator end() const;
+
+    IndexMemoryUsage GetIndexMemoryUsage() const;
+    // Rebuilds the index into a fresh pool with no free blocks and exact capacities, returning the
+    // memory freed by removed documents to the system. The index is left unchanged if it throws.
+    void Compact();
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
 
@@ -61,6 +193,13 @@ public:
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, std::string_view raw_query, int document_id) const;
 
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ThreadPoolPolicy, std::string_view raw_query, int document_id) const;
+
+    // Calls given thread_pool_policy run their parallel parts on this pool. A pool with default
+    // options is started on first use; the options must not change while a call uses the pool.
+    void SetThreadPoolOptions(const ThreadPoolOptions& options);
+    ThreadPool& GetThreadPool() const;
+
     void RemoveDocument(int document_id);
     template <typename Ex_Pol>
     void RemoveDocument(Ex_Pol ep, int document_id);
@@ -70,41 +209,135 @@ private:
     {
         int rating;
         DocumentStatus status;
+        int word_count;
     };
 
+    // Carries the inverse length of its document, so scorers normalize without a document lookup
+    struct Posting
+    {
+        double term_freq;
+        double inv_document_length;
+    };
+    using DocumentPostings = IndexMap<int, Posting>;
+
     struct QueryWord
     {
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_prefix;
+    };
+
+    // Words of a "quoted phrase" with their offsets in it; slop is how many extra
+    // words may stand between them ("quick fox"~2)
+    struct QueryPhrase
+    {
+        std::vector<std::string_view> words;
+        std::vector<int> offsets;
+        int slop = 0;
     };
 
     struct Query
     {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<QueryPhrase> phrases;
+        PrefixExpansions prefix_expansions;
     };
 
-    const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::set<int> document_ids_;
-    std::map<int, DocumentData> documents_;
+    using DocumentPositions = IndexMap<int, IndexVector<uint8_t>>;
+
+    const StopWordSet stop_words_;
+
+    // The index containers take their memory from index_memory_. They sit in unions so that their
+    // destructors never run: ~SearchServer frees the pool's chunks at once instead of every node.
+    std::unique_ptr<IndexMemory> index_memory_;
+
+    // Words are keyed by their id in term_dictionary_, which keeps the only copy of them
+    using TermId = TermDictionary::TermId;
+    using WordToDocumentFreqs = IndexMap<TermId, DocumentPostings>;
+    using DocumentToWordFreqs = IndexMap<int, IndexMap<TermId, double>>;
+    using WordToDocumentPositions = IndexMap<TermId, DocumentPositions>;
+
+    union
+    {
+        WordToDocumentFreqs word_to_document_freqs_;
+    };
+    union
+    {
+        DocumentToWordFreqs document_to_word_freqs_;
+    };
+    union
+    {
+        IndexSet<int> document_ids_;
+    };
+    union
+    {
+        IndexMap<int, DocumentData> documents_;
+    };
+    // Delta and varint encoded word positions, decoded only for phrase queries
+    union
+    {
+        WordToDocumentPositions word_to_document_positions_;
+    };
+
+    int64_t total_word_count_ = 0;
+    uint64_t index_generation_ = 0;
+    std::map<DocumentStatus, int> status_document_counts_;
+    bool is_positional_index_enabled_ = false;
+    // The indexed words and their ids, also walked in order for prefix queries
+    TermDictionary term_dictionary_;
+    // Rejects most query words missing from word_to_document_freqs_ before the tree is searched.
+    // Words are added as they are indexed; removed ones stay until it is rebuilt.
+    TermFilter term_filter_;
+    mutable std::shared_ptr<ThreadPool> thread_pool_;
+    // Every so many document ids, in order, for splitting parallel queries into ranges of about as
+    // many documents each however the ids are spread
+    struct DocumentIdQuantiles
+    {
+        std::vector<int> ids;
+        uint64_t index_generation = 0;
+    };
+    mutable std::shared_ptr<const DocumentIdQuantiles> document_id_quantiles_;
 
     bool IsStopWord(std::string_view word) const;
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
-
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     QueryWord ParseQueryWord(std::string_view text) const;
-    Query ParseQuery(std::string_view text, bool skip_sort=false) const;
+    // Prefix words expand in the dictionary unless expansions are given
+    Query ParseQuery(std::string_view text, bool skip_sort=false, const PrefixExpansions* prefix_expansions=nullptr) const;
 
     double ComputeWordInverseDocumentFreq(std::string_view word) const;
 
-    template <typename Ex_Pol, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(Ex_Pol ep, const Query& query, DocumentPredicate document_predicate) const;
+    // Rebuilt on first use once the documents have changed by an eighth, nearly right is good enough
+    std::shared_ptr<const DocumentIdQuantiles> GetDocumentIdQuantiles() const;
+
+    // Posting list of the word, or nullptr if it is not indexed
+    const DocumentPostings* FindWordDocumentFreqs(std::string_view word) const;
+    void AddTermFilterWord(std::string_view word);
+    // Sized for twice the indexed words, so that it is rebuilt after the dictionary doubles
+    void RebuildTermFilter();
+
+    // Appends the indexed words starting with the prefix, viewing the dictionary's copies
+    void ExpandPrefixWord(std::string_view prefix, std::vector<std::string_view>& words) const;
+
+    void AddDocumentPositions(int document_id, std::string_view document);
+    // Smallest number of extra words inside a match of the phrase, or -1 if the document does not contain it
+    int FindPhraseGap(const QueryPhrase& phrase, int document_id) const;
+    // Throws if the query has phrases but the positional index is off, like FindTopDocuments
+    bool MatchesQueryPhrases(const Query& query, int document_id) const;
+    void ApplyQueryPhrases(const Query& query, std::vector<Document>& matched_documents) const;
+
+    // With facets the filter is applied after the status of every match is counted
+    template <typename Scorer, typename Ex_Pol, typename DocumentPredicate, typename InverseDocumentFreq>
+    std::vector<Document> FindAllDocuments(Ex_Pol ep, const Query& query, DocumentPredicate document_predicate,
+        InverseDocumentFreq inverse_document_freq, FacetCounts* facets = nullptr) const;
+
+    // Puts the best count documents in order and drops the rest
+    template <typename Ex_Pol>
+    static void KeepTopDocuments(Ex_Pol ep, std::vector<Document>& documents, size_t count);
     
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
@@ -113,6 +346,12 @@ private:
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , index_memory_(std::make_unique<IndexMemory>())
+    , word_to_document_freqs_(&index_memory_->dictionary)
+    , document_to_word_freqs_(&index_memory_->forward_index)
+    , document_ids_(&index_memory_->documents)
+    , documents_(&index_memory_->documents)
+    , word_to_document_positions_(&index_memory_->positions)
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord))
     {
@@ -123,106 +362,368 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const
 {
-    return SearchServer::FindAllDocuments(std::execution::seq, query, document_predicate);
+    return SearchServer::FindAllDocuments<TfIdfScorer>(std::execution::seq, query, document_predicate, [this](std::string_view word)
+        {
+            return ComputeWordInverseDocumentFreq(word);
+        });
 }
 
-template <typename DocumentPredicate>
+template <typename Scorer, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const
 {
-    return SearchServer::FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    return SearchServer::FindTopDocuments<Scorer>(std::execution::seq, raw_query, document_predicate);
 }
 
-template <typename Ex_Pol, typename DocumentPredicate>
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, status);
+}
+
+template <typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const
+{
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const
 {
     const auto query = ParseQuery(raw_query);
-    std::vector<Document> matched_documents = FindAllDocuments(ep, query, document_predicate);
-    sort(ep, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs)
-         {
-             if (std::abs(lhs.relevance - rhs.relevance) < EPSILON)
-             {
-                 return lhs.rating > rhs.rating;
-             }
-             else
-             {
-                 return lhs.relevance > rhs.relevance;
-             }
-         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT)
-    {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    std::vector<Document> matched_documents = FindAllDocuments<Scorer>(ep, query, document_predicate, [this](std::string_view word)
+        {
+            return ComputeWordInverseDocumentFreq(word);
+        });
+    KeepTopDocuments(ep, matched_documents, MAX_RESULT_DOCUMENT_COUNT);
     return matched_documents;
 }
 
-template <typename Ex_Pol>
-std::vector<Document> SearchServer::FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate,
+    InverseDocumentFreq inverse_document_freq, const PrefixExpansions& prefix_expansions) const
 {
-    return FindTopDocuments(ep, raw_query, [status](int document_id, DocumentStatus document_status, int rating)
+    const auto query = ParseQuery(raw_query, false, &prefix_expansions);
+    std::vector<Document> matched_documents = FindAllDocuments<Scorer>(ep, query, document_predicate, inverse_document_freq);
+    KeepTopDocuments(ep, matched_documents, MAX_RESULT_DOCUMENT_COUNT);
+    return matched_documents;
+}
+
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindRankedDocuments(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const
+{
+    const auto query = ParseQuery(raw_query);
+    std::vector<Document> matched_documents = FindAllDocuments<Scorer>(ep, query, document_predicate, [this](std::string_view word)
         {
-            return document_status == status;
+            return ComputeWordInverseDocumentFreq(word);
         });
+    KeepTopDocuments(ep, matched_documents, matched_documents.size());
+    return matched_documents;
+}
+
+template <typename Scorer, typename Ex_Pol>
+std::vector<Document> SearchServer::FindRankedDocuments(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const
+{
+    return FindRankedDocuments<Scorer>(ep, raw_query, DocumentStatusPredicate{ status });
+}
+
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query, DocumentPredicate document_predicate) const
+{
+    const auto query = ParseQuery(raw_query);
+    FacetedSearchResult result;
+    result.documents = FindAllDocuments<Scorer>(ep, query, document_predicate, [this](std::string_view word)
+        {
+            return ComputeWordInverseDocumentFreq(word);
+        }, &result.facets);
+    KeepTopDocuments(ep, result.documents, MAX_RESULT_DOCUMENT_COUNT);
+    return result;
+}
+
+template <typename Scorer, typename Ex_Pol>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocumentsWithFacets<Scorer>(ep, raw_query, DocumentStatusPredicate{ status });
+}
+
+template <typename Scorer, typename Ex_Pol>
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(Ex_Pol ep, std::string_view raw_query) const
+{
+    return FindTopDocumentsWithFacets<Scorer>(ep, raw_query, DocumentStatus::ACTUAL);
 }
 
 template <typename Ex_Pol>
+void SearchServer::KeepTopDocuments(Ex_Pol ep, std::vector<Document>& matched_documents, size_t count)
+{
+    // Only the top documents are put in order
+    const auto top_end = matched_documents.begin() + std::min(matched_documents.size(), count);
+    auto is_ranked_higher = [](const Document& lhs, const Document& rhs)
+    {
+        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON)
+        {
+            return lhs.rating > rhs.rating;
+        }
+        else
+        {
+            return lhs.relevance > rhs.relevance;
+        }
+    };
+    if constexpr (std::is_same_v<Ex_Pol, ThreadPoolPolicy>)
+    {
+        std::partial_sort(matched_documents.begin(), top_end, matched_documents.end(), is_ranked_higher);
+    }
+    else
+    {
+        std::partial_sort(ep, matched_documents.begin(), top_end, matched_documents.end(), is_ranked_higher);
+    }
+    matched_documents.erase(top_end, matched_documents.end());
+}
+
+template <typename Scorer, typename Ex_Pol>
+std::vector<Document> SearchServer::FindTopDocuments(Ex_Pol ep, std::string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocuments<Scorer>(ep, raw_query, DocumentStatusPredicate{ status });
+}
+
+template <typename Scorer, typename Ex_Pol>
 std::vector<Document> SearchServer::FindTopDocuments(Ex_Pol ep, std::string_view raw_query) const
 {
-    return FindTopDocuments(ep, raw_query, DocumentStatus::ACTUAL);
+    return FindTopDocuments<Scorer>(ep, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename Ex_Pol, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(Ex_Pol ep, const Query& query, DocumentPredicate document_predicate) const
+template <typename Scorer, typename Ex_Pol, typename DocumentPredicate, typename InverseDocumentFreq>
+std::vector<Document> SearchServer::FindAllDocuments(Ex_Pol ep, const Query& query, DocumentPredicate document_predicate,
+    InverseDocumentFreq inverse_document_freq, FacetCounts* facets) const
 {
-    ConcurrentMap<int, double> document_to_relevance(document_ids_.size());
-    std::for_each(ep, query.plus_words.begin(), query.plus_words.end(), [&](std::string_view word)
+    constexpr bool is_status_predicate = std::is_same_v<DocumentPredicate, DocumentStatusPredicate>;
+    constexpr bool is_posting_predicate = !is_status_predicate && !std::is_same_v<DocumentPredicate, AcceptAllPredicate>;
+
+    if (!query.phrases.empty() && !is_positional_index_enabled_)
+    {
+        throw std::invalid_argument("Phrase queries need the positional index");
+    }
+
+    const bool is_faceted = facets != nullptr;
+    if constexpr (is_status_predicate)
+    {
+        const int status_document_count = GetDocumentCount(document_predicate.status);
+        // Facets still count the statuses of the matches
+        if (status_document_count == 0 && !is_faceted)
+        {
+            return {};
+        }
+        if (status_document_count == GetDocumentCount())
+        {
+            return FindAllDocuments<Scorer>(ep, query, AcceptAllPredicate(), inverse_document_freq, facets);
+        }
+    }
+
+    const Scorer scorer(GetCorpusStatistics());
+    auto add_word_relevance = [&](std::string_view word, int first_id, int last_id, auto add_relevance)
+    {
+        const auto* document_freqs_ptr = FindWordDocumentFreqs(word);
+        if (document_freqs_ptr == nullptr)
+        {
+            return;
+        }
+        const double term_weight = scorer.GetTermWeight(inverse_document_freq(word));
+        const auto& document_freqs = *document_freqs_ptr;
+        for (auto it = document_freqs.lower_bound(first_id); it != document_freqs.end() && it->first <= last_id; ++it)
+        {
+            const auto& [document_id, posting] = *it;
+            if constexpr (is_posting_predicate)
+            {
+                const auto& document_data = documents_.at(document_id);
+                if (!is_faceted && !document_predicate(document_id, document_data.status, document_data.rating))
+                {
+                    continue;
+                }
+            }
+            add_relevance(document_id, scorer.Score(term_weight, posting.term_freq, posting.inv_document_length));
+        }
+    };
+
+    size_t range_count = 1;
+    if constexpr (!std::is_same_v<Ex_Pol, std::execution::sequenced_policy>)
+    {
+        size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        if constexpr (std::is_same_v<Ex_Pol, ThreadPoolPolicy>)
+        {
+            thread_count = GetThreadPool().GetThreadCount();
+        }
+        range_count = std::clamp<size_t>(document_ids_.size() / MIN_QUERY_RANGE_DOCUMENT_COUNT, 1, thread_count * QUERY_RANGES_PER_THREAD);
+    }
+
+    // Scores the documents with ids in [first_id, last_id] into a private vector sorted by id
+    auto find_range_documents = [&](int first_id, int last_id, FacetCounts* range_facets)
+    {
+        // Posting lists are sorted by id, so they are merged one by one with no map or locks
+        std::vector<std::pair<int, double>> document_to_relevance;
+        std::vector<std::pair<int, double>> merged;
+        for (std::string_view word : query.plus_words)
+        {
+            merged.clear();
+            auto it = document_to_relevance.begin();
+            add_word_relevance(word, first_id, last_id, [&](int document_id, double relevance)
+                {
+                    for (; it != document_to_relevance.end() && it->first < document_id; ++it)
+                    {
+                        merged.push_back(*it);
+                    }
+                    if (it != document_to_relevance.end() && it->first == document_id)
+                    {
+                        relevance += it->second;
+                        ++it;
+                    }
+                    merged.emplace_back(document_id, relevance);
+                });
+            merged.insert(merged.end(), it, document_to_relevance.end());
+            std::swap(document_to_relevance, merged);
+        }
+
+        // Minus words drop the documents once instead of being checked for every posting
+        for (std::string_view word : query.minus_words)
         {
-            if (word_to_document_freqs_.count(word) != 0)
+            if (document_to_relevance.empty())
             {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto& [document_id, term_freq] : (*word_to_document_freqs_.find(word)).second)
+                break;
+            }
+            const auto* minus_document_freqs_ptr = FindWordDocumentFreqs(word);
+            if (minus_document_freqs_ptr == nullptr)
+            {
+                continue;
+            }
+            const auto& minus_document_freqs = *minus_document_freqs_ptr;
+            auto minus_it = minus_document_freqs.lower_bound(first_id);
+            // The range holds about 1 / range_count of the minus word postings
+            const bool is_walked = minus_document_freqs.size() < 8 * document_to_relevance.size() * range_count;
+            const auto removed_begin = std::remove_if(document_to_relevance.begin(), document_to_relevance.end(),
+                [&](const std::pair<int, double>& document)
                 {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating) && 
-                        std::all_of(query.minus_words.begin(), query.minus_words.end(), [&](std::string_view minus_word)
-                            {
-                                return (document_to_word_freqs_.at(document_id).count(minus_word) == 0);
-                            }))
+                    if (!is_walked)
                     {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+                        return minus_document_freqs.count(document.first) > 0;
                     }
+                    for (; minus_it != minus_document_freqs.end() && minus_it->first < document.first; ++minus_it)
+                    {
+                    }
+                    return minus_it != minus_document_freqs.end() && minus_it->first == document.first;
+                });
+            document_to_relevance.erase(removed_begin, document_to_relevance.end());
+        }
+
+        std::vector<Document> range_documents;
+        range_documents.reserve(document_to_relevance.size());
+        for (const auto& [document_id, relevance] : document_to_relevance)
+        {
+            const auto& document_data = documents_.at(document_id);
+            if constexpr (is_status_predicate)
+            {
+                if (!is_faceted && document_data.status != document_predicate.status)
+                {
+                    continue;
                 }
             }
-        });
-    
+            range_documents.push_back({ document_id, relevance, document_data.rating });
+        }
+
+        if (range_facets != nullptr)
+        {
+            if (!query.phrases.empty())
+            {
+                ApplyQueryPhrases(query, range_documents);
+            }
+            const auto filtered_end = std::remove_if(range_documents.begin(), range_documents.end(), [&](const Document& document)
+                {
+                    const DocumentStatus status = documents_.at(document.id).status;
+                    ++range_facets->status_counts[status];
+                    if (!document_predicate(document.id, status, document.rating))
+                    {
+                        return true;
+                    }
+                    ++range_facets->rating_counts[document.rating];
+                    return false;
+                });
+            range_documents.erase(filtered_end, range_documents.end());
+        }
+        return range_documents;
+    };
+
     std::vector<Document> matched_documents;
-    const auto doc_to_rel = document_to_relevance.BuildOrdinaryMap();
-    for (const auto& [document_id, relevance] : doc_to_rel)
+    if (range_count == 1)
     {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        matched_documents = find_range_documents(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), facets);
+    }
+    else
+    {
+        // The id space is split rather than the query words, so a query with one common word still
+        // keeps every thread busy. Ranges come out sorted by id and are simply concatenated.
+        const auto quantiles = GetDocumentIdQuantiles();
+        auto get_range_begin = [&](size_t range_index) -> int64_t
+        {
+            if (range_index == 0)
+            {
+                return std::numeric_limits<int>::min();
+            }
+            if (range_index == range_count)
+            {
+                return static_cast<int64_t>(std::numeric_limits<int>::max()) + 1;
+            }
+            return quantiles->ids[range_index * quantiles->ids.size() / range_count];
+        };
+        std::vector<std::vector<Document>> range_documents(range_count);
+        // Every range counts into its own facets, merged once all ranges are done
+        std::vector<FacetCounts> range_facets(is_faceted ? range_count : 0);
+        auto find_indexed_range_documents = [&](size_t range_index)
+        {
+            const int64_t range_begin = get_range_begin(range_index);
+            const int64_t range_end = get_range_begin(range_index + 1);
+            if (range_begin < range_end)
+            {
+                range_documents[range_index] = find_range_documents(static_cast<int>(range_begin), static_cast<int>(range_end - 1),
+                    is_faceted ? &range_facets[range_index] : nullptr);
+            }
+        };
+        if constexpr (std::is_same_v<Ex_Pol, ThreadPoolPolicy>)
+        {
+            GetThreadPool().ParallelFor(range_count, find_indexed_range_documents);
+        }
+        else
+        {
+            std::vector<size_t> range_indexes(range_count);
+            std::iota(range_indexes.begin(), range_indexes.end(), 0);
+            std::for_each(ep, range_indexes.begin(), range_indexes.end(), find_indexed_range_documents);
+        }
+        size_t matched_document_count = 0;
+        for (const auto& documents : range_documents)
+        {
+            matched_document_count += documents.size();
+        }
+        matched_documents.reserve(matched_document_count);
+        for (const auto& documents : range_documents)
+        {
+            matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+        }
+        if (facets != nullptr)
+        {
+            for (const FacetCounts& counts : range_facets)
+            {
+                facets->Merge(counts);
+            }
+        }
+    }
+    // Faceted ranges have matched the phrases already, before counting
+    if (!query.phrases.empty() && !is_faceted)
+    {
+        ApplyQueryPhrases(query, matched_documents);
     }
     return matched_documents;
 }
 
 template <typename Ex_Pol>
-void SearchServer::RemoveDocument(Ex_Pol ep, int document_id)
+void SearchServer::RemoveDocument(Ex_Pol, int document_id)
 {
-    if (document_ids_.find(document_id) == document_ids_.end())
-    {
-        return;
-    }
-    std::vector<std::string_view> words;
-    words.reserve(document_to_word_freqs_[document_id].size());
-    for (auto& [word, _] : document_to_word_freqs_[document_id])
-    {
-        words.push_back(std::move(word));
-    }
-    std::for_each(ep, words.begin(), words.end(), [this, document_id](const std::string& word)
-        {
-            this->word_to_document_freqs_[word].erase(document_id);
-        });
-    document_to_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
+    // The index pool is not thread safe, so the postings are erased sequentially with any policy
+    RemoveDocument(document_id);
 }
 
 
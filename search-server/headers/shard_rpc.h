@@ -0,0 +1,109 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <tuple>
+#include <vector>
+
+// Binary RPC between a ShardCoordinator and SearchServer shards living in separate processes
+// on the same host. Every frame is a fixed header (payload size, request id, opcode, status)
+// followed by the payload; integers are in host byte order since both ends share the host.
+// Requests are pipelined: a connection may carry many outstanding requests, responses come back
+// in order and are matched by request id.
+
+// Serves one SearchServer over a Unix domain socket
+class ShardRpcServer
+{
+public:
+    ShardRpcServer(const std::string& socket_path, SearchServer& search_server);
+    ~ShardRpcServer();
+
+    ShardRpcServer(const ShardRpcServer&) = delete;
+    ShardRpcServer& operator=(const ShardRpcServer&) = delete;
+
+    // Handles requests until Stop is called
+    void Serve();
+    void Stop();
+
+private:
+    std::string socket_path_;
+    SearchServer& search_server_;
+    int listen_fd_ = -1;
+    std::atomic<bool> is_stopped_ = false;
+};
+
+// Runs the search_server_shard executable serving an empty SearchServer on the socket; the process
+// is killed on destruction, or when the thread that started it exits. The child execs right after
+// fork, so the owner may already run threads.
+class ShardProcess
+{
+public:
+    ShardProcess(const std::string& shard_executable, const std::string& socket_path, const std::string& stop_words_text);
+    ~ShardProcess();
+
+    ShardProcess(const ShardProcess&) = delete;
+    ShardProcess& operator=(const ShardProcess&) = delete;
+
+    pid_t GetPid() const;
+
+private:
+    std::string socket_path_;
+    pid_t pid_ = -1;
+};
+
+struct ScatterGatherResult
+{
+    std::vector<Document> documents;
+    size_t shard_count = 0;
+    size_t answered_shard_count = 0;
+
+    // Some shards did not answer in time and their documents are missing
+    bool IsPartial() const;
+};
+
+struct RemoteDocument
+{
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// Routes documents to shard processes by id and scatters queries to all of them. Ranking uses
+// document frequencies summed over the shards and prefix words expanded over all their
+// dictionaries, so it matches a single SearchServer. A shard that does not take the request or
+// answer within the timeout is left out of the result instead of failing the query. A broken
+// connection is opened again on the next request, so a restarted shard rejoins.
+class ShardCoordinator
+{
+public:
+    ShardCoordinator(const std::vector<std::string>& socket_paths, std::chrono::milliseconds shard_timeout);
+    ~ShardCoordinator();
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Pipelines the documents to their shards without waiting for every acknowledgement
+    void AddDocuments(const std::vector<RemoteDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    ScatterGatherResult FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    // Prefix words expand in the dictionary of the document's shard only, like in ShardedSearchServer
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id);
+
+    size_t GetShardCount() const;
+
+private:
+    class ShardConnection;
+
+    std::vector<std::unique_ptr<ShardConnection>> shards_;
+    std::chrono::milliseconds shard_timeout_;
+
+    ShardConnection& GetShard(int document_id);
+};
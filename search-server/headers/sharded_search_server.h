@@ -0,0 +1,181 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Partitions documents by id across several SearchServer shards. Every shard is served by
+// its own worker thread pinned to a CPU; queries are scattered to all shards and the per-shard
+// top documents are merged. IDF is computed from global document frequencies, so the ranking
+// is the same as the one of a single SearchServer holding all documents.
+class ShardedSearchServer
+{
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(size_t shard_count, const StringContainer& stop_words);
+    ShardedSearchServer(size_t shard_count, const std::string& stop_words_text);
+    ShardedSearchServer(size_t shard_count, std::string_view stop_words_text);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    // Prefix words expand in the dictionary of the document's shard, so with more than
+    // MAX_PREFIX_EXPANSION_COUNT words in all shards more of them may match than in a single server
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    void RemoveDocument(int document_id);
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+
+    std::set<int>::const_iterator begin() const;
+    std::set<int>::const_iterator end() const;
+
+private:
+    class Shard
+    {
+    public:
+        template <typename StringContainer>
+        Shard(const StringContainer& stop_words, int cpu);
+        ~Shard();
+
+        // Runs the task on the shard's worker thread
+        template <typename Task>
+        auto Run(Task task) -> std::future<decltype(task(std::declval<SearchServer&>()))>;
+
+    private:
+        SearchServer server_;
+        std::mutex mut_;
+        std::condition_variable cv_;
+        std::deque<std::function<void()>> tasks_;
+        bool is_stopped_ = false;
+        std::thread worker_;
+
+        void StartWorker(int cpu);
+        void WorkerLoop();
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::set<int> document_ids_;
+
+    Shard& GetShard(int document_id) const;
+    // Merges the statistics of the query words of all shards, asking every shard once
+    QueryTermStatistics GetQueryTermStatistics(std::string_view raw_query) const;
+
+    // Waits for all results before rethrowing an error, as the tasks may view the caller's data
+    template <typename Result>
+    static std::vector<Result> GetAll(std::vector<std::future<Result>>& results);
+};
+
+template <typename StringContainer>
+ShardedSearchServer::Shard::Shard(const StringContainer& stop_words, int cpu)
+    : server_(stop_words)
+{
+    StartWorker(cpu);
+}
+
+template <typename Task>
+auto ShardedSearchServer::Shard::Run(Task task) -> std::future<decltype(task(std::declval<SearchServer&>()))>
+{
+    using Result = decltype(task(std::declval<SearchServer&>()));
+    auto packaged_task = std::make_shared<std::packaged_task<Result()>>([this, task = std::move(task)]() mutable
+        {
+            return task(server_);
+        });
+    auto result = packaged_task->get_future();
+    {
+        std::lock_guard lg(mut_);
+        tasks_.push_back([packaged_task]
+            {
+                (*packaged_task)();
+            });
+    }
+    cv_.notify_one();
+    return result;
+}
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const StringContainer& stop_words)
+{
+    if (shard_count == 0)
+    {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+    const int cpu_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i)
+    {
+        shards_.push_back(std::make_unique<Shard>(stop_words, static_cast<int>(i) % cpu_count));
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const
+{
+    const QueryTermStatistics statistics = GetQueryTermStatistics(raw_query);
+    const std::map<std::string_view, double> inverse_document_freqs = statistics.ComputeInverseDocumentFreqs();
+    // Every word a shard ranks by is indexed by that shard, so its frequency is in the map
+    auto inverse_document_freq = [&inverse_document_freqs](std::string_view word)
+    {
+        return inverse_document_freqs.find(word)->second;
+    };
+
+    std::vector<std::future<std::vector<Document>>> shard_results;
+    shard_results.reserve(shards_.size());
+    for (const auto& shard : shards_)
+    {
+        shard_results.push_back(shard->Run([raw_query, document_predicate, inverse_document_freq, &statistics](SearchServer& server)
+            {
+                return std::as_const(server).FindTopDocuments(std::execution::seq, raw_query, document_predicate, inverse_document_freq,
+                    statistics.prefix_expansions);
+            }));
+    }
+
+    std::vector<Document> matched_documents;
+    for (const auto& documents : GetAll(shard_results))
+    {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs)
+        {
+            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON)
+            {
+                return lhs.rating > rhs.rating;
+            }
+            else
+            {
+                return lhs.relevance > rhs.relevance;
+            }
+        });
+    if (matched_documents.size() > static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT))
+    {
+        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return matched_documents;
+}
+
+template <typename Result>
+std::vector<Result> ShardedSearchServer::GetAll(std::vector<std::future<Result>>& results)
+{
+    for (const auto& result : results)
+    {
+        result.wait();
+    }
+    std::vector<Result> values;
+    values.reserve(results.size());
+    for (auto& result : results)
+    {
+        values.push_back(result.get());
+    }
+    return values;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of words behind a minimal perfect hash: every word has its own slot, found with
+// one hash of the looked up word and a single comparison. Words are grouped into buckets by the
+// hash, and every bucket gets a seed that sends its words to free slots (hash and displace).
+class StopWordSet
+{
+public:
+    StopWordSet() = default;
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    bool Contains(std::string_view word) const;
+
+    size_t size() const;
+    // Words in slot order
+    std::vector<std::string>::const_iterator begin() const;
+    std::vector<std::string>::const_iterator end() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    // Average words per bucket; larger buckets take fewer seeds but longer to place
+    static const size_t BUCKET_SIZE = 2;
+
+    std::vector<std::string> words_;
+    std::vector<uint32_t> bucket_seeds_;
+
+    size_t GetBucket(uint64_t hash) const;
+    size_t GetSlot(uint64_t hash, uint32_t seed) const;
+};
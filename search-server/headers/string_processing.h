@@ -1,13 +1,20 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 
 std::vector<std::string> SplitIntoWords(const std::string& text);
 std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
 
+// Fast non-cryptographic hash of a word, the same in every process
+uint64_t HashWord(std::string_view word);
+// Scrambles the bits of a hash, e.g. to derive another hash of the same word
+uint64_t MixHash(uint64_t hash);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings)
 {
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Owns the indexed terms and numbers them, so that the index is keyed by term ids instead of
+// strings. Term bytes are appended to chunks that never move: a term view stays valid until the
+// term is removed or the dictionary is rebuilt. Exact lookups go through an open addressing table
+// of ids. Prefix lookups walk the ids sorted by term; terms added or removed since the sort are
+// kept aside and merged in once they make up an eighth of the dictionary, and only then are the
+// ids of removed terms given out again.
+class TermDictionary
+{
+public:
+    using TermId = uint32_t;
+
+    TermDictionary() = default;
+    // Terms must be sorted and unique, they get ids in that order
+    explicit TermDictionary(const std::vector<std::string_view>& sorted_terms);
+
+    size_t size() const;
+    // Every id is less than this
+    size_t GetIdBound() const;
+
+    std::optional<TermId> Find(std::string_view term) const;
+    std::string_view GetTerm(TermId id) const;
+
+    // The term must be missing; its bytes are copied
+    TermId Add(std::string_view term);
+    // The term must be in the dictionary
+    void Remove(TermId id);
+
+    // Calls visit(id, term) for the terms starting with the prefix, in sorted order, at most
+    // max_count of them
+    template <typename Visitor>
+    void VisitPrefix(std::string_view prefix, size_t max_count, Visitor visit) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t MIN_CHUNK_SIZE = 4096;
+    static constexpr size_t MAX_CHUNK_SIZE = 1 << 20;
+    static constexpr size_t MIN_MERGE_SIZE = 64;
+    static constexpr size_t MIN_SLOT_COUNT = 16;
+    static constexpr TermId EMPTY_SLOT = UINT32_MAX;
+    static constexpr TermId REMOVED_SLOT = UINT32_MAX - 1;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t chunk_size_ = 0;
+    size_t chunk_used_ = 0;
+    size_t chunk_bytes_ = 0;
+
+    // By id; a removed term keeps its view until its id is given out again
+    std::vector<std::string_view> terms_;
+    std::vector<bool> is_removed_;
+    std::vector<TermId> free_ids_;
+    size_t term_count_ = 0;
+
+    std::vector<TermId> slots_;
+    size_t used_slot_count_ = 0;
+
+    std::vector<TermId> sorted_ids_;
+    std::map<std::string_view, TermId> added_terms_;
+    std::vector<TermId> removed_ids_;
+
+    std::string_view StoreTerm(std::string_view term);
+    // Slot of the term, or the empty slot its probe ends at
+    size_t FindSlot(std::string_view term) const;
+    void InsertSlot(TermId id);
+    void Rehash(size_t term_count);
+    void MergeIfNeeded();
+};
+
+template <typename Visitor>
+void TermDictionary::VisitPrefix(std::string_view prefix, size_t max_count, Visitor visit) const
+{
+    auto has_prefix = [prefix](std::string_view term)
+    {
+        return term.substr(0, prefix.size()) == prefix;
+    };
+    auto sorted_it = std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), prefix, [this](TermId id, std::string_view term)
+        {
+            return terms_[id] < term;
+        });
+    auto added_it = added_terms_.lower_bound(prefix);
+    for (size_t count = 0; count < max_count; ++count)
+    {
+        while (sorted_it != sorted_ids_.end() && is_removed_[*sorted_it])
+        {
+            ++sorted_it;
+        }
+        const bool has_sorted_term = sorted_it != sorted_ids_.end() && has_prefix(terms_[*sorted_it]);
+        const bool has_added_term = added_it != added_terms_.end() && has_prefix(added_it->first);
+        if (has_sorted_term && (!has_added_term || terms_[*sorted_it] < added_it->first))
+        {
+            visit(*sorted_it, terms_[*sorted_it]);
+            ++sorted_it;
+        }
+        else if (has_added_term)
+        {
+            visit(added_it->second, added_it->first);
+            ++added_it;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
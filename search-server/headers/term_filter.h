@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Split block Bloom filter over the indexed words: every word sets one bit in each 32-bit lane of
+// a single 32-byte block, so a lookup reads one cache line. Absent words are rejected with no
+// false negatives and about 0.5% false positives at the planned capacity.
+class TermFilter
+{
+public:
+    explicit TermFilter(size_t capacity = 0);
+
+    void Add(std::string_view term);
+    // False means the term was never added
+    bool MayContain(std::string_view term) const;
+
+    // More terms than this raise the false positive rate, the filter should be rebuilt larger
+    size_t GetCapacity() const;
+    size_t GetTermCount() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static const size_t BITS_PER_TERM = 16;
+
+    struct alignas(32) Block
+    {
+        std::array<uint32_t, 8> lanes;
+    };
+
+    std::vector<Block> blocks_;
+    size_t capacity_ = 0;
+    size_t term_count_ = 0;
+
+    static Block MakeMask(uint64_t hash);
+    size_t GetBlockIndex(uint64_t hash) const;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPoolOptions
+{
+    // Threads taking part in a parallel call, the calling thread included; 0 takes one per CPU
+    // the process may run on
+    size_t thread_count = 0;
+    // Keeps every worker on a single CPU
+    bool pin_threads = false;
+    // Spreads workers over the NUMA nodes round-robin and keeps each on the CPUs of its node, so
+    // the memory a worker touches first is local to it
+    bool numa_aware = false;
+};
+
+struct ThreadPoolStatistics
+{
+    size_t thread_count = 0;
+    size_t task_count = 0;
+    // Tasks run by a thread other than the worker whose queue held them
+    size_t stolen_task_count = 0;
+    size_t queued_task_count = 0;
+    // Longest queue of a single worker seen so far
+    size_t max_queue_depth = 0;
+};
+
+// Execution policy: the parallel parts of a SearchServer call run on the server's ThreadPool
+struct ThreadPoolPolicy
+{
+};
+inline constexpr ThreadPoolPolicy thread_pool_policy{};
+
+// Work-stealing pool: every worker has its own task queue, takes its newest task first and, when
+// the queue is empty, steals the oldest task of another worker. Threads waiting for a parallel call
+// run queued tasks meanwhile, so tasks may start nested parallel calls.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(const ThreadPoolOptions& options = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    // Calls function(i) for every i in [0, count) and returns when all calls are done, rethrowing
+    // the first exception. Indexes are cut into a few contiguous chunks per thread.
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    // Runs the task on a worker. A pool task must not wait for the result, which may deadlock;
+    // ParallelFor is the way to wait inside the pool.
+    template <typename Task>
+    auto Submit(Task task) -> std::future<decltype(task())>;
+
+    ThreadPoolStatistics GetStatistics() const;
+
+private:
+    static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+    struct WorkerQueue
+    {
+        std::mutex mut;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct Job
+    {
+        std::mutex mut;
+        std::condition_variable cv;
+        size_t remaining_chunk_count = 0;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::atomic<size_t> next_queue_ = 0;
+    std::atomic<size_t> queued_task_count_ = 0;
+    std::atomic<size_t> task_count_ = 0;
+    std::atomic<size_t> stolen_task_count_ = 0;
+    std::atomic<size_t> max_queue_depth_ = 0;
+    std::mutex sleep_mut_;
+    std::condition_variable sleep_cv_;
+    bool is_stopped_ = false;
+    std::vector<std::thread> workers_;
+
+    void Push(std::function<void()> task);
+    bool TryRunTask();
+    void Wait(Job& job);
+    void WorkerLoop(size_t index);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function)
+{
+    const size_t chunk_count = std::min(count, GetThreadCount() * CHUNKS_PER_THREAD);
+    if (workers_.empty() || chunk_count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            function(i);
+        }
+        return;
+    }
+
+    Job job;
+    job.remaining_chunk_count = chunk_count;
+    auto run_chunk = [&job, &function, count, chunk_count](size_t chunk)
+    {
+        try
+        {
+            for (size_t i = count * chunk / chunk_count; i < count * (chunk + 1) / chunk_count; ++i)
+            {
+                function(i);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lg(job.mut);
+            if (!job.error)
+            {
+                job.error = std::current_exception();
+            }
+        }
+        // The job lives on the waiting thread's stack, it must not be touched after the mutex is released
+        std::lock_guard lg(job.mut);
+        if (--job.remaining_chunk_count == 0)
+        {
+            job.cv.notify_all();
+        }
+    };
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk)
+    {
+        Push([&run_chunk, chunk]
+            {
+                run_chunk(chunk);
+            });
+    }
+    run_chunk(0);
+    Wait(job);
+    if (job.error)
+    {
+        std::rethrow_exception(job.error);
+    }
+}
+
+template <typename Task>
+auto ThreadPool::Submit(Task task) -> std::future<decltype(task())>
+{
+    using Result = decltype(task());
+    auto packaged_task = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    auto result = packaged_task->get_future();
+    if (workers_.empty())
+    {
+        (*packaged_task)();
+    }
+    else
+    {
+        Push([packaged_task]
+            {
+                (*packaged_task)();
+            });
+    }
+    return result;
+}
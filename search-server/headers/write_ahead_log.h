@@ -0,0 +1,100 @@
+#pragma once
+
+#include "document.h"
+#include "mapped_file.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Append-only log of index changes. Every record is a header (payload size, CRC-32 of the payload)
+// followed by the payload; integers are in host byte order since the log is read back on the same host.
+
+enum class LogOperation : uint8_t
+{
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT,
+};
+
+struct LogRecord
+{
+    LogOperation operation = LogOperation::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    // Views the log file held by the LogReader
+    std::string_view text;
+};
+
+struct WriteAheadLogStatistics
+{
+    size_t record_count = 0;
+    size_t byte_count = 0;
+    // record_count / sync_count is the average number of records sharing one fdatasync
+    size_t sync_count = 0;
+};
+
+// Appends records to the end of a file. Appending only copies the record into a buffer; a flusher
+// thread writes everything buffered so far with one write and one fdatasync, so writers waiting
+// concurrently share a sync (group commit). A damaged tail left by a crash must be cut off before
+// the file is opened for appending, see LogReader::GetValidSize.
+class WriteAheadLog
+{
+public:
+    explicit WriteAheadLog(const std::string& path);
+    // Syncs the records appended so far
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Return the sequence number of the record to wait for
+    uint64_t AppendAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendRemoveDocument(int document_id);
+
+    // Blocks until the record and all records before it are on disk
+    void WaitDurable(uint64_t sequence_number);
+    void Sync();
+
+    WriteAheadLogStatistics GetStatistics() const;
+
+private:
+    int fd_ = -1;
+    mutable std::mutex mut_;
+    std::condition_variable data_ready_;
+    std::condition_variable data_written_;
+    std::string buffer_;
+    uint64_t appended_sequence_number_ = 0;
+    uint64_t durable_sequence_number_ = 0;
+    // errno of a failed write or sync; records appended after it are never written
+    int error_ = 0;
+    bool is_stopped_ = false;
+    WriteAheadLogStatistics statistics_;
+    std::thread flusher_;
+
+    uint64_t Append(const std::string& record);
+    void FlushLoop();
+};
+
+// Reads the records of a log; reading stops at the first torn or damaged record. A missing file
+// reads as an empty log.
+class LogReader
+{
+public:
+    explicit LogReader(const std::string& path);
+
+    const std::vector<LogRecord>& GetRecords() const;
+    // Bytes up to the end of the last valid record
+    size_t GetValidSize() const;
+    size_t GetSize() const;
+
+private:
+    std::optional<MappedFile> file_;
+    std::vector<LogRecord> records_;
+    size_t valid_size_ = 0;
+};
@@ -0,0 +1,418 @@
+#include "document_loader.h"
+#include "mapped_file.h"
+
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+
+// Views the mapped file
+struct ParsedDocument
+{
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+    string_view text;
+    vector<string_view> words;
+};
+
+struct ParsedBatch
+{
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    vector<ParsedDocument> documents;
+    size_t rejected_line_count = 0;
+};
+
+bool ParseNumber(string_view text, int& value)
+{
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status)
+{
+    static const pair<string_view, DocumentStatus> STATUS_NAMES[] = {
+        { "ACTUAL"sv, DocumentStatus::ACTUAL },
+        { "IRRELEVANT"sv, DocumentStatus::IRRELEVANT },
+        { "BANNED"sv, DocumentStatus::BANNED },
+        { "REMOVED"sv, DocumentStatus::REMOVED },
+    };
+    for (const auto& [name, value] : STATUS_NAMES)
+    {
+        if (text == name)
+        {
+            status = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+string_view CutField(string_view& line)
+{
+    const size_t tab_pos = line.find('\t');
+    if (tab_pos == line.npos)
+    {
+        const string_view field = line;
+        line = {};
+        return field;
+    }
+    const string_view field = line.substr(0, tab_pos);
+    line.remove_prefix(tab_pos + 1);
+    return field;
+}
+
+bool ParseLine(const SearchServer& search_server, string_view line, ParsedDocument& document)
+{
+    const string_view id = CutField(line);
+    const string_view status = CutField(line);
+    string_view ratings = CutField(line);
+    if (!ParseNumber(id, document.id) || !ParseStatus(status, document.status))
+    {
+        return false;
+    }
+    while (!ratings.empty())
+    {
+        const size_t space_pos = ratings.find(' ');
+        int rating = 0;
+        if (space_pos != 0 && !ParseNumber(ratings.substr(0, space_pos), rating))
+        {
+            return false;
+        }
+        if (space_pos != 0)
+        {
+            document.ratings.push_back(rating);
+        }
+        ratings.remove_prefix(space_pos == ratings.npos ? ratings.size() : space_pos + 1);
+    }
+    document.text = line;
+    try
+    {
+        document.words = search_server.SplitIntoWordsNoStop(line);
+    }
+    catch (const invalid_argument&)
+    {
+        return false;
+    }
+    return true;
+}
+
+ParsedBatch ParseBatch(const SearchServer& search_server, const char* begin, const char* end)
+{
+    ParsedBatch batch;
+    batch.begin = begin;
+    batch.end = end;
+    while (begin < end)
+    {
+        const char* line_end = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        if (line_end == nullptr)
+        {
+            line_end = end;
+        }
+        string_view line(begin, line_end - begin);
+        begin = line_end + 1;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+        ParsedDocument document;
+        if (ParseLine(search_server, line, document))
+        {
+            batch.documents.push_back(move(document));
+        }
+        else
+        {
+            ++batch.rejected_line_count;
+        }
+    }
+    return batch;
+}
+
+// Cuts the piece of whole lines starting at next_offset
+bool CutPiece(const MappedFile& file, size_t batch_bytes, size_t& next_offset, const char*& begin, const char*& end)
+{
+    const size_t size = file.GetSize();
+    if (next_offset >= size)
+    {
+        return false;
+    }
+    const char* data = file.GetData();
+    begin = data + next_offset;
+    end = data + min(size, next_offset + batch_bytes);
+    if (end < data + size)
+    {
+        const char* line_end = static_cast<const char*>(memchr(end, '\n', data + size - end));
+        end = line_end == nullptr ? data + size : line_end + 1;
+    }
+    next_offset = end - data;
+    return true;
+}
+
+// Parser threads take the file piece by piece and hand parsed batches to the indexing thread. Batches
+// are numbered as their pieces are taken and popped in that order, so documents are indexed in file
+// order however the parsers are scheduled, like in PooledParsePipeline.
+class ParsePipeline
+{
+public:
+    ParsePipeline(const SearchServer& search_server, const MappedFile& file, const LoadOptions& options)
+        : search_server_(search_server)
+        , file_(file)
+        , batch_bytes_(max<size_t>(options.batch_bytes, 1))
+        , max_queued_batch_count_(max<size_t>(options.max_queued_batch_count, 1))
+        , active_parser_count_(max<size_t>(options.parser_thread_count, 1))
+    {
+        for (size_t i = 0; i < active_parser_count_; ++i)
+        {
+            parsers_.emplace_back([this]
+                {
+                    ParserLoop();
+                });
+        }
+    }
+
+    ~ParsePipeline()
+    {
+        {
+            lock_guard lock(mutex_);
+            is_stopped_ = true;
+        }
+        queue_not_full_.notify_all();
+        for (thread& parser : parsers_)
+        {
+            parser.join();
+        }
+    }
+
+    ParsePipeline(const ParsePipeline&) = delete;
+    ParsePipeline& operator=(const ParsePipeline&) = delete;
+
+    // Returns false when the whole file is parsed and taken
+    bool Pop(ParsedBatch& batch)
+    {
+        unique_lock lock(mutex_);
+        batch_ready_.wait(lock, [this]
+            {
+                return ready_batches_.count(next_pop_index_) > 0 || active_parser_count_ == 0;
+            });
+        if (parser_error_)
+        {
+            rethrow_exception(parser_error_);
+        }
+        const auto batch_it = ready_batches_.find(next_pop_index_);
+        if (batch_it == ready_batches_.end())
+        {
+            return false;
+        }
+        batch = move(batch_it->second);
+        ready_batches_.erase(batch_it);
+        ++next_pop_index_;
+        lock.unlock();
+        // Any parser may hold the batch that now fits
+        queue_not_full_.notify_all();
+        return true;
+    }
+
+private:
+    const SearchServer& search_server_;
+    const MappedFile& file_;
+    const size_t batch_bytes_;
+    const size_t max_queued_batch_count_;
+
+    mutex mutex_;
+    condition_variable batch_ready_;
+    condition_variable queue_not_full_;
+    // Parsed batches by the index of their piece, waiting for the ones before them to be popped
+    map<size_t, ParsedBatch> ready_batches_;
+    size_t next_offset_ = 0;
+    size_t next_piece_index_ = 0;
+    size_t next_pop_index_ = 0;
+    size_t active_parser_count_;
+    bool is_stopped_ = false;
+    exception_ptr parser_error_;
+    vector<thread> parsers_;
+
+    bool TakePiece(const char*& begin, const char*& end, size_t& piece_index)
+    {
+        lock_guard lock(mutex_);
+        if (is_stopped_ || !CutPiece(file_, batch_bytes_, next_offset_, begin, end))
+        {
+            return false;
+        }
+        piece_index = next_piece_index_++;
+        return true;
+    }
+
+    void ParserLoop()
+    {
+        try
+        {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+            size_t piece_index = 0;
+            while (TakePiece(begin, end, piece_index))
+            {
+                ParsedBatch batch = ParseBatch(search_server_, begin, end);
+                unique_lock lock(mutex_);
+                // Counted from the next batch to pop, so that batch always fits and the indexer never
+                // waits for a parser that waits for room
+                queue_not_full_.wait(lock, [this, piece_index]
+                    {
+                        return is_stopped_ || piece_index < next_pop_index_ + max_queued_batch_count_;
+                    });
+                if (is_stopped_)
+                {
+                    break;
+                }
+                ready_batches_.emplace(piece_index, move(batch));
+                lock.unlock();
+                batch_ready_.notify_one();
+            }
+        }
+        catch (...)
+        {
+            lock_guard lock(mutex_);
+            parser_error_ = current_exception();
+            is_stopped_ = true;
+        }
+        {
+            lock_guard lock(mutex_);
+            --active_parser_count_;
+        }
+        batch_ready_.notify_all();
+        queue_not_full_.notify_all();
+    }
+};
+
+// Parses pieces as tasks on the server's thread pool. Batches come back in file order; the number of
+// pieces in flight keeps the workers busy and bounds memory like ParsePipeline does.
+class PooledParsePipeline
+{
+public:
+    PooledParsePipeline(const SearchServer& search_server, const MappedFile& file, const LoadOptions& options)
+        : search_server_(search_server)
+        , file_(file)
+        , batch_bytes_(max<size_t>(options.batch_bytes, 1))
+        , max_in_flight_batch_count_(max<size_t>(options.max_queued_batch_count, 1) + search_server.GetThreadPool().GetThreadCount())
+    {
+
+    }
+
+    ~PooledParsePipeline()
+    {
+        // Tasks view the file, which must stay mapped until they finish
+        for (const auto& batch : in_flight_batches_)
+        {
+            batch.wait();
+        }
+    }
+
+    PooledParsePipeline(const PooledParsePipeline&) = delete;
+    PooledParsePipeline& operator=(const PooledParsePipeline&) = delete;
+
+    bool Pop(ParsedBatch& batch)
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        while (in_flight_batches_.size() < max_in_flight_batch_count_ && CutPiece(file_, batch_bytes_, next_offset_, begin, end))
+        {
+            in_flight_batches_.push_back(search_server_.GetThreadPool().Submit([this, begin, end]
+                {
+                    return ParseBatch(search_server_, begin, end);
+                }));
+        }
+        if (in_flight_batches_.empty())
+        {
+            return false;
+        }
+        auto next_batch = move(in_flight_batches_.front());
+        in_flight_batches_.pop_front();
+        batch = next_batch.get();
+        return true;
+    }
+
+private:
+    const SearchServer& search_server_;
+    const MappedFile& file_;
+    const size_t batch_bytes_;
+    const size_t max_in_flight_batch_count_;
+    size_t next_offset_ = 0;
+    deque<future<ParsedBatch>> in_flight_batches_;
+};
+
+template <typename Pipeline>
+void IndexBatches(SearchServer& search_server, const MappedFile& file, Pipeline& pipeline, LoadStatistics& statistics)
+{
+    ParsedBatch batch;
+    while (pipeline.Pop(batch))
+    {
+        statistics.rejected_line_count += batch.rejected_line_count;
+        for (const ParsedDocument& document : batch.documents)
+        {
+            try
+            {
+                search_server.AddDocument(document.id, document.text, document.words, document.status, document.ratings);
+                ++statistics.document_count;
+            }
+            catch (const invalid_argument&)
+            {
+                ++statistics.rejected_line_count;
+            }
+        }
+        file.Release(batch.begin, batch.end);
+    }
+}
+
+}
+
+double LoadStatistics::GetDocumentsPerSecond() const
+{
+    return seconds > 0 ? document_count / seconds : 0;
+}
+
+double LoadStatistics::GetMegabytesPerSecond() const
+{
+    return seconds > 0 ? byte_count / (1024.0 * 1024.0) / seconds : 0;
+}
+
+ostream& operator<<(ostream& out, const LoadStatistics& statistics)
+{
+    return out << "loaded "s << statistics.document_count << " documents ("s << statistics.byte_count << " bytes, "s
+        << statistics.rejected_line_count << " rejected lines) in "s << statistics.seconds << " s: "s
+        << statistics.GetDocumentsPerSecond() << " documents/s, "s << statistics.GetMegabytesPerSecond() << " MB/s"s;
+}
+
+LoadStatistics LoadDocuments(SearchServer& search_server, const string& path, const LoadOptions& options)
+{
+    const auto start = chrono::steady_clock::now();
+    const MappedFile file(path);
+    LoadStatistics statistics;
+    statistics.byte_count = file.GetSize();
+    if (options.use_thread_pool)
+    {
+        PooledParsePipeline pipeline(search_server, file, options);
+        IndexBatches(search_server, file, pipeline, statistics);
+    }
+    else
+    {
+        ParsePipeline pipeline(search_server, file, options);
+        IndexBatches(search_server, file, pipeline, statistics);
+    }
+    statistics.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return statistics;
+}
@@ -0,0 +1,288 @@
+#include "durable_search_server.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+
+// Documents split in parallel before the indexing thread takes them
+const size_t REPLAY_BATCH_SIZE = 4096;
+
+system_error MakeSystemError(const string& what)
+{
+    return system_error(errno, generic_category(), what);
+}
+
+void SyncPath(const string& path, int flags)
+{
+    const int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw MakeSystemError("Can not open "s + path);
+    }
+    if (fsync(fd) < 0)
+    {
+        const int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), "Can not sync "s + path);
+    }
+    close(fd);
+}
+
+// Makes created, renamed and removed files durable
+void SyncDirectory(const string& directory)
+{
+    SyncPath(directory, O_RDONLY | O_DIRECTORY);
+}
+
+void RemoveFile(const string& path)
+{
+    if (unlink(path.c_str()) < 0 && errno != ENOENT)
+    {
+        throw MakeSystemError("Can not remove "s + path);
+    }
+}
+
+// Operations on different documents commute and a later operation on a document overrides the
+// earlier ones, so only the documents whose last operation is an addition need to be indexed
+vector<const LogRecord*> CollectLiveDocuments(initializer_list<const LogReader*> logs)
+{
+    unordered_map<int, const LogRecord*> last_records;
+    for (const LogReader* log : logs)
+    {
+        for (const LogRecord& record : log->GetRecords())
+        {
+            last_records[record.document_id] = &record;
+        }
+    }
+    vector<const LogRecord*> live_documents;
+    live_documents.reserve(last_records.size());
+    for (const auto& [document_id, record] : last_records)
+    {
+        if (record->operation == LogOperation::ADD_DOCUMENT)
+        {
+            live_documents.push_back(record);
+        }
+    }
+    sort(live_documents.begin(), live_documents.end(), [](const LogRecord* lhs, const LogRecord* rhs)
+        {
+            return lhs->document_id < rhs->document_id;
+        });
+    return live_documents;
+}
+
+}
+
+DurableSearchServer::DurableSearchServer(const string& directory, string_view stop_words_text)
+    : directory_(directory)
+    , server_(stop_words_text)
+{
+    Recover();
+    log_ = make_shared<WriteAheadLog>(GetLogPath());
+    SyncDirectory(directory_);
+}
+
+template <typename AppendRecord, typename ApplyChange>
+void DurableSearchServer::LogAndApply(unique_lock<shared_mutex>& lock, int document_id, AppendRecord append_record, ApplyChange apply_change)
+{
+    const shared_ptr<WriteAheadLog> log = log_;
+    pending_document_ids_.insert(document_id);
+    try
+    {
+        const uint64_t sequence_number = append_record(*log);
+        lock.unlock();
+        log->WaitDurable(sequence_number);
+        lock.lock();
+    }
+    catch (...)
+    {
+        if (!lock.owns_lock())
+        {
+            lock.lock();
+        }
+        pending_document_ids_.erase(document_id);
+        throw;
+    }
+    pending_document_ids_.erase(document_id);
+    apply_change();
+}
+
+void DurableSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    // Invalid documents are rejected before anything is logged
+    const vector<string_view> words = server_.SplitIntoWordsNoStop(document);
+    unique_lock lock(mut_);
+    if ((document_id < 0) || server_.HasDocument(document_id) || pending_document_ids_.count(document_id) > 0)
+    {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    LogAndApply(lock, document_id, [&](WriteAheadLog& log)
+        {
+            return log.AppendAddDocument(document_id, document, status, ratings);
+        }, [&]
+        {
+            server_.AddDocument(document_id, document, words, status, ratings);
+        });
+}
+
+void DurableSearchServer::RemoveDocument(int document_id)
+{
+    unique_lock lock(mut_);
+    if (!server_.HasDocument(document_id) || pending_document_ids_.count(document_id) > 0)
+    {
+        return;
+    }
+    LogAndApply(lock, document_id, [document_id](WriteAheadLog& log)
+        {
+            return log.AppendRemoveDocument(document_id);
+        }, [this, document_id]
+        {
+            server_.RemoveDocument(document_id);
+        });
+}
+
+void DurableSearchServer::Checkpoint()
+{
+    lock_guard checkpoint_lock(checkpoint_mut_);
+    // Left by a checkpoint that failed or crashed
+    if (access(GetFrozenLogPath().c_str(), F_OK) == 0)
+    {
+        CompactSnapshot();
+    }
+
+    shared_ptr<WriteAheadLog> frozen_log;
+    {
+        unique_lock lock(mut_);
+        if (rename(GetLogPath().c_str(), GetFrozenLogPath().c_str()) < 0)
+        {
+            throw MakeSystemError("Can not rename "s + GetLogPath());
+        }
+        try
+        {
+            auto log = make_shared<WriteAheadLog>(GetLogPath());
+            // Records of the new log must not be acknowledged before its name is durable
+            SyncDirectory(directory_);
+            frozen_log = exchange(log_, move(log));
+        }
+        catch (...)
+        {
+            rename(GetFrozenLogPath().c_str(), GetLogPath().c_str());
+            throw;
+        }
+    }
+    // Writers appended to the frozen log before it was switched; their records are in it once it is synced
+    frozen_log->Sync();
+    frozen_log.reset();
+    CompactSnapshot();
+}
+
+void DurableSearchServer::CompactSnapshot()
+{
+    const string temporary_path = GetSnapshotPath() + ".tmp"s;
+    {
+        const LogReader snapshot(GetSnapshotPath());
+        const LogReader frozen_log(GetFrozenLogPath());
+        RemoveFile(temporary_path);
+        WriteAheadLog compacted(temporary_path);
+        for (const LogRecord* record : CollectLiveDocuments({ &snapshot, &frozen_log }))
+        {
+            compacted.AppendAddDocument(record->document_id, record->text, record->status, record->ratings);
+        }
+        compacted.Sync();
+    }
+    if (rename(temporary_path.c_str(), GetSnapshotPath().c_str()) < 0)
+    {
+        throw MakeSystemError("Can not rename "s + temporary_path);
+    }
+    SyncDirectory(directory_);
+    // A crash before the frozen log is gone replays it over the snapshot, which changes nothing
+    RemoveFile(GetFrozenLogPath());
+    SyncDirectory(directory_);
+}
+
+int DurableSearchServer::GetDocumentCount() const
+{
+    shared_lock lock(mut_);
+    return server_.GetDocumentCount();
+}
+
+const RecoveryStatistics& DurableSearchServer::GetRecoveryStatistics() const
+{
+    return recovery_statistics_;
+}
+
+WriteAheadLogStatistics DurableSearchServer::GetLogStatistics() const
+{
+    shared_lock lock(mut_);
+    return log_->GetStatistics();
+}
+
+string DurableSearchServer::GetSnapshotPath() const
+{
+    return directory_ + "/snapshot.wal"s;
+}
+
+string DurableSearchServer::GetLogPath() const
+{
+    return directory_ + "/current.wal"s;
+}
+
+string DurableSearchServer::GetFrozenLogPath() const
+{
+    return directory_ + "/frozen.wal"s;
+}
+
+void DurableSearchServer::Recover()
+{
+    const auto start = chrono::steady_clock::now();
+    const LogReader snapshot(GetSnapshotPath());
+    const LogReader frozen_log(GetFrozenLogPath());
+    const LogReader log(GetLogPath());
+    // The snapshot is renamed into place only after it has been synced, so it can not be torn
+    if (snapshot.GetValidSize() != snapshot.GetSize())
+    {
+        throw runtime_error("Snapshot "s + GetSnapshotPath() + " is damaged"s);
+    }
+
+    const auto live_documents = CollectLiveDocuments({ &snapshot, &frozen_log, &log });
+    for (size_t begin = 0; begin < live_documents.size(); begin += REPLAY_BATCH_SIZE)
+    {
+        const size_t end = min(live_documents.size(), begin + REPLAY_BATCH_SIZE);
+        vector<vector<string_view>> words(end - begin);
+        server_.GetThreadPool().ParallelFor(end - begin, [this, &words, &live_documents, begin](size_t i)
+            {
+                words[i] = server_.SplitIntoWordsNoStop(live_documents[begin + i]->text);
+            });
+        for (size_t i = begin; i < end; ++i)
+        {
+            const LogRecord& record = *live_documents[i];
+            server_.AddDocument(record.document_id, record.text, words[i - begin], record.status, record.ratings);
+        }
+    }
+
+    // Records appended after a torn tail would never be read back
+    if (log.GetValidSize() != log.GetSize())
+    {
+        if (truncate(GetLogPath().c_str(), static_cast<off_t>(log.GetValidSize())) < 0)
+        {
+            throw MakeSystemError("Can not truncate "s + GetLogPath());
+        }
+        SyncPath(GetLogPath(), O_WRONLY);
+    }
+
+    recovery_statistics_.snapshot_record_count = snapshot.GetRecords().size();
+    recovery_statistics_.log_record_count = frozen_log.GetRecords().size() + log.GetRecords().size();
+    recovery_statistics_.document_count = live_documents.size();
+    // A torn tail of the frozen log is dropped by the next checkpoint
+    recovery_statistics_.discarded_byte_count = frozen_log.GetSize() - frozen_log.GetValidSize() + log.GetSize() - log.GetValidSize();
+    recovery_statistics_.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,97 @@
+#include "generators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+ZipfDistribution::ZipfDistribution(size_t size, double exponent)
+{
+    if (size == 0)
+    {
+        throw invalid_argument("Zipf distribution needs a non-empty range"s);
+    }
+    cumulative_weights_.reserve(size);
+    double total_weight = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        total_weight += 1.0 / pow(static_cast<double>(i + 1), exponent);
+        cumulative_weights_.push_back(total_weight);
+    }
+}
+
+size_t ZipfDistribution::operator()(mt19937& generator) const
+{
+    const double point = uniform_real_distribution<>(0, cumulative_weights_.back())(generator);
+    const auto it = upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), point);
+    return min(static_cast<size_t>(it - cumulative_weights_.begin()), cumulative_weights_.size() - 1);
+}
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+template <typename WordIndexGenerator>
+static string GenerateQueryWith(mt19937& generator, const vector<string>& dictionary, WordIndexGenerator word_index,
+    int word_count, double minus_prob) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[word_index()];
+    }
+    return query;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob) {
+    return GenerateQueryWith(generator, dictionary, [&] {
+            return uniform_int_distribution<int>(0, dictionary.size() - 1)(generator);
+        }, word_count, minus_prob);
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& word_distribution,
+    int word_count, double minus_prob) {
+    return GenerateQueryWith(generator, dictionary, [&] {
+            return word_distribution(generator);
+        }, word_count, minus_prob);
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& word_distribution,
+    int query_count, int max_word_count, double minus_prob) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, word_distribution, max_word_count, minus_prob));
+    }
+    return queries;
+}
@@ -0,0 +1,42 @@
+#include "index_memory.h"
+
+using namespace std;
+
+CountingMemoryResource::CountingMemoryResource(pmr::memory_resource* upstream)
+    : upstream_(upstream)
+{
+}
+
+size_t CountingMemoryResource::GetAllocatedBytes() const
+{
+    return allocated_bytes_;
+}
+
+void* CountingMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* p = upstream_->allocate(bytes, alignment);
+    allocated_bytes_ += bytes;
+    return p;
+}
+
+void CountingMemoryResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    upstream_->deallocate(p, bytes, alignment);
+    allocated_bytes_ -= bytes;
+}
+
+bool CountingMemoryResource::do_is_equal(const pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+double IndexMemoryUsage::GetAveragePostingLength() const
+{
+    return term_count > 0 ? static_cast<double>(posting_count) / term_count : 0;
+}
+
+size_t IndexMemoryUsage::GetFreeBytes() const
+{
+    const size_t used_bytes = dictionary_bytes + posting_bytes + position_bytes + forward_index_bytes + document_bytes;
+    return reserved_bytes > used_bytes ? reserved_bytes - used_bytes : 0;
+}
@@ -0,0 +1,61 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw system_error(errno, generic_category(), "Can not open "s + path);
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) < 0)
+    {
+        const int error = errno;
+        close(fd);
+        throw system_error(error, generic_category(), "Can not stat "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0)
+    {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            const int error = errno;
+            close(fd);
+            throw system_error(error, generic_category(), "Can not map "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+        madvise(data, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+    {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+void MappedFile::Release(const char* begin, const char* end) const
+{
+    const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + page_size - 1) / page_size * page_size;
+    const uintptr_t last = reinterpret_cast<uintptr_t>(end) / page_size * page_size;
+    if (first < last)
+    {
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    }
+}
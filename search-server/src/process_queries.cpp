@@ -11,6 +11,16 @@ std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_ser
     return result;
 }
 
+std::vector<std::vector<Document>> ProcessQueries(ThreadPoolPolicy, const SearchServer& search_server, const std::vector<std::string>& queries)
+{
+    std::vector<std::vector<Document>> result(queries.size());
+    search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t i)
+        {
+            result[i] = search_server.FindTopDocuments(thread_pool_policy, queries[i]);
+        });
+    return result;
+}
+
 std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
 {
     std::list<Document> result;
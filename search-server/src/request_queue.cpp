@@ -10,5 +10,10 @@ RequestQueue::RequestQueue(const SearchServer& search_server)
 
 int RequestQueue::GetNoResultRequests() const
 {
-    return static_cast<int>(number_of_no_result_requests_);
+    return static_cast<int>(GetStatistics(chrono::hours(24)).no_result_count);
+}
+
+RequestWindowStatistics RequestQueue::GetStatistics(RequestStatistics::Clock::duration window) const
+{
+    return statistics_.GetStatistics(window, RequestStatistics::Clock::now());
 }
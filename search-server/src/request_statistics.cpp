@@ -0,0 +1,119 @@
+#include "request_statistics.h"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+
+template <typename Period>
+uint64_t GetTick(RequestStatistics::Clock::time_point time)
+{
+    return static_cast<uint64_t>(chrono::duration_cast<Period>(time.time_since_epoch()).count());
+}
+
+// First tick of the window ending at the time, a started tick counted whole
+template <typename Period>
+uint64_t GetFirstTick(RequestStatistics::Clock::duration window, RequestStatistics::Clock::time_point time)
+{
+    const uint64_t tick_count = static_cast<uint64_t>((window + Period(1) - RequestStatistics::Clock::duration(1)) / Period(1));
+    const uint64_t end_tick = GetTick<Period>(time) + 1;
+    return end_tick > tick_count ? end_tick - tick_count : 0;
+}
+
+}
+
+chrono::nanoseconds RequestWindowStatistics::GetAverageLatency() const
+{
+    return request_count > 0 ? latency_sum / static_cast<int64_t>(request_count) : chrono::nanoseconds(0);
+}
+
+void RequestStatistics::Record(Clock::time_point time, bool is_empty, Clock::duration latency)
+{
+    const uint64_t latency_ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(latency).count());
+    const uint64_t second = GetTick<chrono::seconds>(time);
+    const uint64_t minute = GetTick<chrono::minutes>(time);
+    RecordSlot(second_slots_[second % SECOND_SLOT_COUNT], second, is_empty, latency_ns);
+    RecordSlot(minute_slots_[minute % MINUTE_SLOT_COUNT], minute, is_empty, latency_ns);
+}
+
+RequestWindowStatistics RequestStatistics::GetStatistics(Clock::duration window, Clock::time_point time) const
+{
+    if (window <= Clock::duration::zero() || window > chrono::hours(24))
+    {
+        throw invalid_argument("Statistics window must be positive and at most a day"s);
+    }
+    RequestWindowStatistics statistics;
+    if (window <= chrono::seconds(SECOND_SLOT_COUNT))
+    {
+        for (uint64_t tick = GetFirstTick<chrono::seconds>(window, time); tick <= GetTick<chrono::seconds>(time); ++tick)
+        {
+            AddSlot(second_slots_[tick % SECOND_SLOT_COUNT], tick, statistics);
+        }
+    }
+    else
+    {
+        for (uint64_t tick = GetFirstTick<chrono::minutes>(window, time); tick <= GetTick<chrono::minutes>(time); ++tick)
+        {
+            AddSlot(minute_slots_[tick % MINUTE_SLOT_COUNT], tick, statistics);
+        }
+    }
+    return statistics;
+}
+
+void RequestStatistics::RecordSlot(Slot& slot, uint64_t tick, bool is_empty, uint64_t latency_ns)
+{
+    uint64_t slot_tick = slot.tick.load(memory_order_acquire);
+    while (slot_tick != tick)
+    {
+        if (slot_tick & RESETTING_TICK_FLAG)
+        {
+            // Another thread is clearing the slot, which takes three stores
+            this_thread::yield();
+            slot_tick = slot.tick.load(memory_order_acquire);
+            continue;
+        }
+        if (slot_tick != EMPTY_TICK && slot_tick > tick)
+        {
+            // Recorded so late that the slot holds a newer tick already
+            return;
+        }
+        if (slot.tick.compare_exchange_weak(slot_tick, tick | RESETTING_TICK_FLAG, memory_order_acquire))
+        {
+            slot.request_count.store(0, memory_order_relaxed);
+            slot.no_result_count.store(0, memory_order_relaxed);
+            slot.latency_sum_ns.store(0, memory_order_relaxed);
+            slot.tick.store(tick, memory_order_release);
+            break;
+        }
+    }
+    slot.request_count.fetch_add(1, memory_order_relaxed);
+    if (is_empty)
+    {
+        slot.no_result_count.fetch_add(1, memory_order_relaxed);
+    }
+    slot.latency_sum_ns.fetch_add(latency_ns, memory_order_relaxed);
+}
+
+void RequestStatistics::AddSlot(const Slot& slot, uint64_t tick, RequestWindowStatistics& statistics)
+{
+    if (slot.tick.load(memory_order_acquire) != tick)
+    {
+        return;
+    }
+    // Acquire loads keep the tick check below after them
+    const uint64_t request_count = slot.request_count.load(memory_order_acquire);
+    const uint64_t no_result_count = slot.no_result_count.load(memory_order_acquire);
+    const uint64_t latency_sum_ns = slot.latency_sum_ns.load(memory_order_acquire);
+    // The slot has been taken for a later tick while it was read
+    if (slot.tick.load(memory_order_acquire) != tick)
+    {
+        return;
+    }
+    statistics.request_count += request_count;
+    statistics.no_result_count += no_result_count;
+    statistics.latency_sum += chrono::nanoseconds(latency_sum_ns);
+}
@@ -0,0 +1,120 @@
+#include "result_cursor.h"
+
+using namespace std;
+
+ResultCursorCache::ResultCursorCache(const SearchServer& search_server, const ResultCursorOptions& options)
+    : search_server_(search_server)
+    , options_(options)
+{
+}
+
+ResultPage ResultCursorCache::GetPage(const ResultCursor& cursor)
+{
+    if (cursor.page_size == 0)
+    {
+        throw invalid_argument("Page size must be positive"s);
+    }
+    const auto now = chrono::steady_clock::now();
+    lock_guard lg(mut_);
+    DropExpiredSnapshots(now);
+    const auto it = snapshot_by_id_.find(cursor.snapshot_id);
+    if (it == snapshot_by_id_.end())
+    {
+        throw out_of_range("Result snapshot "s + to_string(cursor.snapshot_id) + " has expired"s);
+    }
+    if (it->second->index_generation != search_server_.GetIndexGeneration())
+    {
+        DropSnapshot(it->second);
+        ++statistics_.expired_snapshot_count;
+        throw out_of_range("Index has changed since result snapshot "s + to_string(cursor.snapshot_id) + " was taken"s);
+    }
+    it->second->last_read_time = now;
+    snapshots_.splice(snapshots_.begin(), snapshots_, it->second);
+    return MakePage(*it->second, cursor.offset, cursor.page_size);
+}
+
+void ResultCursorCache::Close(uint64_t snapshot_id)
+{
+    lock_guard lg(mut_);
+    const auto it = snapshot_by_id_.find(snapshot_id);
+    if (it != snapshot_by_id_.end())
+    {
+        DropSnapshot(it->second);
+    }
+}
+
+ResultCursorStatistics ResultCursorCache::GetStatistics() const
+{
+    lock_guard lg(mut_);
+    return statistics_;
+}
+
+size_t ResultCursorCache::GetSnapshotSize(const Snapshot& snapshot)
+{
+    return sizeof(Snapshot) + snapshot.documents.capacity() * sizeof(RankedDocument);
+}
+
+ResultPage ResultCursorCache::AddSnapshot(const vector<Document>& documents, uint64_t index_generation, size_t page_size)
+{
+    Snapshot snapshot{ 0, index_generation, chrono::steady_clock::now(), {} };
+    // A result larger than the whole budget keeps only its best documents, like FindTopDocuments does
+    const size_t max_document_count = options_.memory_budget > sizeof(Snapshot)
+        ? (options_.memory_budget - sizeof(Snapshot)) / sizeof(RankedDocument) : 0;
+    snapshot.documents.reserve(min(documents.size(), max_document_count));
+    for (size_t i = 0; i < snapshot.documents.capacity() && i < documents.size(); ++i)
+    {
+        snapshot.documents.push_back({ documents[i].id, documents[i].rating, documents[i].relevance });
+    }
+    const size_t snapshot_size = GetSnapshotSize(snapshot);
+
+    lock_guard lg(mut_);
+    DropExpiredSnapshots(snapshot.last_read_time);
+    while (!snapshots_.empty() && statistics_.byte_count + snapshot_size > options_.memory_budget)
+    {
+        DropSnapshot(prev(snapshots_.end()));
+        ++statistics_.evicted_snapshot_count;
+    }
+    snapshot.id = next_snapshot_id_++;
+    snapshots_.push_front(move(snapshot));
+    snapshot_by_id_.emplace(snapshots_.front().id, snapshots_.begin());
+    statistics_.byte_count += snapshot_size;
+    ++statistics_.snapshot_count;
+    return MakePage(snapshots_.front(), 0, page_size);
+}
+
+ResultPage ResultCursorCache::MakePage(const Snapshot& snapshot, size_t offset, size_t page_size)
+{
+    ResultPage page;
+    page.document_count = snapshot.documents.size();
+    const size_t page_begin = min(offset, snapshot.documents.size());
+    const size_t page_end = page_begin + min(page_size, snapshot.documents.size() - page_begin);
+    page.documents.reserve(page_end - page_begin);
+    for (size_t i = page_begin; i < page_end; ++i)
+    {
+        const RankedDocument& document = snapshot.documents[i];
+        page.documents.emplace_back(document.id, document.relevance, document.rating);
+    }
+    if (page_end < snapshot.documents.size())
+    {
+        page.next_cursor = ResultCursor{ snapshot.id, page_end, page_size };
+    }
+    return page;
+}
+
+void ResultCursorCache::DropSnapshot(SnapshotList::iterator it)
+{
+    statistics_.byte_count -= GetSnapshotSize(*it);
+    --statistics_.snapshot_count;
+    snapshot_by_id_.erase(it->id);
+    snapshots_.erase(it);
+}
+
+void ResultCursorCache::DropExpiredSnapshots(chrono::steady_clock::time_point now)
+{
+    // The list is ordered by read time, so the expired snapshots are at its end
+    while (!snapshots_.empty() && now - snapshots_.back().last_read_time >= options_.ttl)
+    {
+        DropSnapshot(prev(snapshots_.end()));
+        ++statistics_.expired_snapshot_count;
+    }
+}
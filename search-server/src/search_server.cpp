@@ -1,9 +1,89 @@
 #include "search_server.h"
 
+#include <cctype>
+#include <charconv>
+#include <new>
+#include <optional>
+
 using namespace std;
 
 int MAX_RESULT_DOCUMENT_COUNT = 5;
 double EPSILON = 1e-6;
+int MAX_PREFIX_EXPANSION_COUNT = 64;
+int MIN_QUERY_RANGE_DOCUMENT_COUNT = 2048;
+int QUERY_RANGES_PER_THREAD = 4;
+
+// Relevance of a document matching a phrase exactly is multiplied by 1 + PHRASE_PROXIMITY_BOOST,
+// looser matches get proportionally less
+static const double PHRASE_PROXIMITY_BOOST = 1.0;
+
+// The term filter of a small index starts at this capacity instead of being rebuilt for every few words
+static const size_t MIN_TERM_FILTER_CAPACITY = 1024;
+
+// Phrases this loose match anywhere in any real document; the cap keeps the gap sums of FindPhraseGap small
+static const int MAX_PHRASE_SLOP = 1 << 20;
+
+// Parallel query ranges start at one of this many document id quantiles
+static const size_t DOCUMENT_ID_QUANTILE_COUNT = 1024;
+
+static void EncodePositions(const vector<int>& positions, IndexVector<uint8_t>& encoded)
+{
+    int previous = 0;
+    for (int position : positions)
+    {
+        for (uint32_t delta = static_cast<uint32_t>(position - previous);; delta >>= 7)
+        {
+            if (delta < 0x80)
+            {
+                encoded.push_back(static_cast<uint8_t>(delta));
+                break;
+            }
+            encoded.push_back(static_cast<uint8_t>(delta | 0x80));
+        }
+        previous = position;
+    }
+}
+
+static vector<int> DecodePositions(const IndexVector<uint8_t>& encoded)
+{
+    vector<int> positions;
+    int position = 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    for (uint8_t byte : encoded)
+    {
+        delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte & 0x80)
+        {
+            shift += 7;
+            continue;
+        }
+        position += static_cast<int>(delta);
+        positions.push_back(position);
+        delta = 0;
+        shift = 0;
+    }
+    return positions;
+}
+
+static int ParsePhraseSlop(string_view suffix)
+{
+    if (suffix.empty())
+    {
+        return 0;
+    }
+    int slop = 0;
+    if (suffix.size() < 2 || suffix[0] != '~' || !isdigit(static_cast<unsigned char>(suffix[1])))
+    {
+        throw invalid_argument("Phrase suffix "s + string(suffix) + " is invalid"s);
+    }
+    const auto [end, error] = from_chars(suffix.data() + 1, suffix.data() + suffix.size(), slop);
+    if (error != errc() || end != suffix.data() + suffix.size() || slop > MAX_PHRASE_SLOP)
+    {
+        throw invalid_argument("Phrase suffix "s + string(suffix) + " is invalid"s);
+    }
+    return slop;
+}
 
 SearchServer::SearchServer(const string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))
@@ -17,31 +97,88 @@ SearchServer::SearchServer(string_view stop_words_text)
 
 }
 
+SearchServer::~SearchServer()
+{
+    // Nothing to do: index_memory_ returns all the memory of the index containers
+}
+
+void SearchServer::EnablePositionalIndex()
+{
+    if (!documents_.empty())
+    {
+        throw logic_error("Positional index must be enabled before documents are added"s);
+    }
+    is_positional_index_enabled_ = true;
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
 {
     if ((document_id < 0) || (documents_.count(document_id) > 0))
     {
         throw invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    AddDocument(document_id, document, SplitIntoWordsNoStop(document), status, ratings);
+}
+
+void SearchServer::AddDocument(int document_id, string_view document, const vector<string_view>& words, DocumentStatus status,
+    const vector<int>& ratings)
+{
+    if ((document_id < 0) || (documents_.count(document_id) > 0))
+    {
+        throw invalid_argument("Invalid document_id"s);
+    }
     const double inv_word_count = 1.0 / words.size();
 
+    auto& word_freqs = document_to_word_freqs_.try_emplace(document_id, &index_memory_->forward_index).first->second;
     for (string_view word : words)
     {
-        word_to_document_freqs_[static_cast<string>(word)][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+        optional<TermId> term_id = term_dictionary_.Find(word);
+        if (!term_id)
+        {
+            term_id = term_dictionary_.Add(word);
+            AddTermFilterWord(word);
+        }
+        DocumentPostings& document_freqs = word_to_document_freqs_.try_emplace(*term_id, &index_memory_->postings).first->second;
+        document_freqs.try_emplace(document_id, Posting{ 0, inv_word_count }).first->second.term_freq += inv_word_count;
+        word_freqs[*term_id] += inv_word_count;
+    }
+
+    if (is_positional_index_enabled_)
+    {
+        AddDocumentPositions(document_id, document);
     }
 
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, static_cast<int>(words.size()) });
+    total_word_count_ += words.size();
+    ++status_document_counts_[status];
     document_ids_.insert(document_id);
+    ++index_generation_;
 }
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const
+void SearchServer::AddDocumentPositions(int document_id, string_view document)
 {
-    return FindTopDocuments(std::execution::seq, raw_query, [status](int document_id, DocumentStatus document_status, int rating)
+    // Stop words take positions too, so that a phrase skipping them does not match across them
+    map<string_view, vector<int>> word_positions;
+    int position = 0;
+    for (string_view word : SplitIntoWordsView(document))
+    {
+        if (!IsStopWord(word))
         {
-            return document_status == status;
-        });
+            word_positions[word].push_back(position);
+        }
+        ++position;
+    }
+    for (const auto& [word, positions] : word_positions)
+    {
+        const TermId term_id = *term_dictionary_.Find(word);
+        DocumentPositions& document_positions = word_to_document_positions_.try_emplace(term_id, &index_memory_->positions).first->second;
+        EncodePositions(positions, document_positions.try_emplace(document_id, &index_memory_->positions).first->second);
+    }
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, DocumentStatusPredicate{ status });
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const
@@ -49,29 +186,226 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocumentsWithFacets(std::execution::seq, raw_query, DocumentStatusPredicate{ status });
+}
+
+FacetedSearchResult SearchServer::FindTopDocumentsWithFacets(string_view raw_query) const
+{
+    return FindTopDocumentsWithFacets(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+}
+
+void FacetCounts::Merge(const FacetCounts& other)
+{
+    for (const auto& [status, count] : other.status_counts)
+    {
+        status_counts[status] += count;
+    }
+    for (const auto& [rating, count] : other.rating_counts)
+    {
+        rating_counts[rating] += count;
+    }
+}
+
+void QueryTermStatistics::Merge(const QueryTermStatistics& other)
+{
+    document_count += other.document_count;
+    for (const auto& [word, count] : other.word_document_counts)
+    {
+        word_document_counts[word] += count;
+    }
+    for (const auto& [prefix, other_words] : other.prefix_expansions)
+    {
+        auto& words = prefix_expansions[prefix];
+        vector<string_view> merged;
+        merged.reserve(words.size() + other_words.size());
+        set_union(words.begin(), words.end(), other_words.begin(), other_words.end(), back_inserter(merged));
+        if (merged.size() > static_cast<size_t>(MAX_PREFIX_EXPANSION_COUNT))
+        {
+            merged.resize(MAX_PREFIX_EXPANSION_COUNT);
+        }
+        words = move(merged);
+    }
+}
+
+map<string_view, double> QueryTermStatistics::ComputeInverseDocumentFreqs() const
+{
+    map<string_view, double> inverse_document_freqs;
+    for (const auto& [word, count] : word_document_counts)
+    {
+        if (count > 0)
+        {
+            inverse_document_freqs.emplace(word, log(document_count * 1.0 / count));
+        }
+    }
+    return inverse_document_freqs;
+}
+
 int SearchServer::GetDocumentCount() const
 {
     return static_cast<int>(documents_.size());
 }
 
-std::set<int>::const_iterator SearchServer::begin() const
+int SearchServer::GetDocumentCount(DocumentStatus status) const
+{
+    const auto it = status_document_counts_.find(status);
+    return it == status_document_counts_.end() ? 0 : it->second;
+}
+
+bool SearchServer::HasDocument(int document_id) const
+{
+    return documents_.count(document_id) > 0;
+}
+
+CorpusStatistics SearchServer::GetCorpusStatistics() const
+{
+    CorpusStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    if (statistics.document_count > 0)
+    {
+        statistics.average_document_length = static_cast<double>(total_word_count_) / statistics.document_count;
+    }
+    return statistics;
+}
+
+uint64_t SearchServer::GetIndexGeneration() const
+{
+    return index_generation_;
+}
+
+IndexSet<int>::const_iterator SearchServer::begin() const
 {
     return document_ids_.begin();
 }
 
-std::set<int>::const_iterator SearchServer::end() const
+IndexSet<int>::const_iterator SearchServer::end() const
 {
     return document_ids_.end();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+IndexMemoryUsage SearchServer::GetIndexMemoryUsage() const
+{
+    IndexMemoryUsage usage;
+    usage.dictionary_bytes = index_memory_->dictionary.GetAllocatedBytes();
+    usage.posting_bytes = index_memory_->postings.GetAllocatedBytes();
+    usage.position_bytes = index_memory_->positions.GetAllocatedBytes();
+    usage.forward_index_bytes = index_memory_->forward_index.GetAllocatedBytes();
+    usage.document_bytes = index_memory_->documents.GetAllocatedBytes();
+    usage.stop_word_bytes = stop_words_.GetMemoryUsage();
+    usage.term_filter_bytes = term_filter_.GetMemoryUsage();
+    usage.term_dictionary_bytes = term_dictionary_.GetMemoryUsage();
+    usage.reserved_bytes = index_memory_->reserved.GetAllocatedBytes();
+
+    usage.term_count = term_dictionary_.size();
+    for (const auto& [_, document_freqs] : word_to_document_freqs_)
+    {
+        usage.posting_count += document_freqs.size();
+    }
+    usage.document_count = documents_.size();
+    return usage;
+}
+
+void SearchServer::Compact()
+{
+    auto memory = make_unique<IndexMemory>();
+
+    // Words are numbered again in dictionary order, which drops the ids of removed ones
+    vector<TermId> old_term_ids;
+    vector<string_view> words;
+    old_term_ids.reserve(term_dictionary_.size());
+    words.reserve(term_dictionary_.size());
+    term_dictionary_.VisitPrefix({}, term_dictionary_.size(), [&](TermId term_id, string_view word)
+        {
+            old_term_ids.push_back(term_id);
+            words.push_back(word);
+        });
+    TermDictionary term_dictionary(words);
+    vector<TermId> new_term_ids(term_dictionary_.GetIdBound());
+    for (size_t i = 0; i < old_term_ids.size(); ++i)
+    {
+        new_term_ids[old_term_ids[i]] = static_cast<TermId>(i);
+    }
+
+    WordToDocumentFreqs word_to_document_freqs(&memory->dictionary);
+    WordToDocumentPositions word_to_document_positions(&memory->positions);
+    for (size_t i = 0; i < old_term_ids.size(); ++i)
+    {
+        const DocumentPostings& document_freqs = word_to_document_freqs_.at(old_term_ids[i]);
+        word_to_document_freqs.emplace_hint(word_to_document_freqs.end(), piecewise_construct, forward_as_tuple(i),
+            forward_as_tuple(document_freqs.begin(), document_freqs.end(), &memory->postings));
+
+        const auto positions_it = word_to_document_positions_.find(old_term_ids[i]);
+        if (positions_it == word_to_document_positions_.end())
+        {
+            continue;
+        }
+        DocumentPositions& new_document_positions = word_to_document_positions.emplace_hint(word_to_document_positions.end(),
+            i, &memory->positions)->second;
+        for (const auto& [document_id, positions] : positions_it->second)
+        {
+            new_document_positions.emplace_hint(new_document_positions.end(), piecewise_construct, forward_as_tuple(document_id),
+                forward_as_tuple(positions.begin(), positions.end(), &memory->positions));
+        }
+    }
+
+    DocumentToWordFreqs document_to_word_freqs(&memory->forward_index);
+    for (const auto& [document_id, word_freqs] : document_to_word_freqs_)
+    {
+        auto& new_word_freqs = document_to_word_freqs.emplace_hint(document_to_word_freqs.end(), document_id,
+            &memory->forward_index)->second;
+        for (const auto& [term_id, term_freq] : word_freqs)
+        {
+            new_word_freqs.emplace(new_term_ids[term_id], term_freq);
+        }
+    }
+
+    IndexSet<int> document_ids(document_ids_.begin(), document_ids_.end(), &memory->documents);
+    IndexMap<int, DocumentData> documents(documents_.begin(), documents_.end(), &memory->documents);
+
+    // The old containers are dropped with their pool, like in ~SearchServer
+    new (&word_to_document_freqs_) WordToDocumentFreqs(move(word_to_document_freqs));
+    new (&document_to_word_freqs_) DocumentToWordFreqs(move(document_to_word_freqs));
+    new (&word_to_document_positions_) WordToDocumentPositions(move(word_to_document_positions));
+    new (&document_ids_) IndexSet<int>(move(document_ids));
+    new (&documents_) IndexMap<int, DocumentData>(move(documents));
+    index_memory_ = move(memory);
+    term_dictionary_ = move(term_dictionary);
+    // Drops the words of removed documents
+    RebuildTermFilter();
+}
+
+int SearchServer::GetWordDocumentCount(string_view word) const
+{
+    const auto* document_freqs = FindWordDocumentFreqs(word);
+    return document_freqs == nullptr ? 0 : static_cast<int>(document_freqs->size());
+}
+
+QueryTermStatistics SearchServer::GetQueryTermStatistics(string_view raw_query) const
 {
-    static map<string_view, double> empty_map = {};
-    if (document_to_word_freqs_.find(document_id) == document_to_word_freqs_.end())
+    Query query = ParseQuery(raw_query);
+    QueryTermStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    for (string_view word : query.plus_words)
     {
-        return empty_map;
+        statistics.word_document_counts.emplace(word, GetWordDocumentCount(word));
+    }
+    statistics.prefix_expansions = move(query.prefix_expansions);
+    return statistics;
+}
+
+SearchServer::WordFrequencies SearchServer::GetWordFrequencies(int document_id) const
+{
+    WordFrequencies word_freqs;
+    const auto it = document_to_word_freqs_.find(document_id);
+    if (it != document_to_word_freqs_.end())
+    {
+        for (const auto& [term_id, term_freq] : it->second)
+        {
+            word_freqs.emplace(term_dictionary_.GetTerm(term_id), term_freq);
+        }
     }
-    return document_to_word_freqs_.at(document_id);
+    return word_freqs;
 }
 
 void SearchServer::RemoveDocument(int document_id)
@@ -80,17 +414,31 @@ void SearchServer::RemoveDocument(int document_id)
     {
         return;
     }
-    for (const auto& [word, _] : document_to_word_freqs_[document_id])
+    for (const auto& [term_id, _] : document_to_word_freqs_.at(document_id))
     {
-        (*word_to_document_freqs_.find(word)).second.erase(document_id);
-        if ((*word_to_document_freqs_.find(word)).second.empty())
+        if (is_positional_index_enabled_)
+        {
+            const auto positions_it = word_to_document_positions_.find(term_id);
+            positions_it->second.erase(document_id);
+            if (positions_it->second.empty())
+            {
+                word_to_document_positions_.erase(positions_it);
+            }
+        }
+        const auto document_freqs_it = word_to_document_freqs_.find(term_id);
+        document_freqs_it->second.erase(document_id);
+        if (document_freqs_it->second.empty())
         {
-            word_to_document_freqs_.erase(word_to_document_freqs_.find(word));
+            word_to_document_freqs_.erase(document_freqs_it);
+            term_dictionary_.Remove(term_id);
         }
     }
     document_to_word_freqs_.erase(document_id);
+    total_word_count_ -= documents_.at(document_id).word_count;
+    --status_document_counts_[documents_.at(document_id).status];
     documents_.erase(document_id);
     document_ids_.erase(document_id);
+    ++index_generation_;
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const
@@ -98,25 +446,22 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
     const Query query = ParseQuery(raw_query);
     auto status = documents_.at(document_id).status;
     vector<string_view> matched_words;
+    if (!MatchesQueryPhrases(query, document_id))
+    {
+        return { vector<string_view>{}, status };
+    }
     for (string_view word : query.minus_words)
     {
-        if (word_to_document_freqs_.count(word) == 0)
+        const auto* document_freqs = FindWordDocumentFreqs(word);
+        if (document_freqs != nullptr && document_freqs->count(document_id) > 0)
         {
-            continue;
-        }
-        if ((*word_to_document_freqs_.find(word)).second.count(document_id))
-        {
-            return { {}, status};
+            return { vector<string_view>{}, status };
         }
     }
     for (string_view word : query.plus_words)
     {
-        if (word_to_document_freqs_.count(word) == 0)
-        {
-            continue;
-        }
-        
-        if ((*word_to_document_freqs_.find(word)).second.count(document_id))
+        const auto* document_freqs = FindWordDocumentFreqs(word);
+        if (document_freqs != nullptr && document_freqs->count(document_id) > 0)
         {
             matched_words.push_back(word);
         }
@@ -137,12 +482,13 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 
     auto words_checker = [this, document_id](string_view word)
     {
-        auto it = word_to_document_freqs_.find(word);
-        return (it != word_to_document_freqs_.end()) && it->second.count(document_id);
+        const auto* document_freqs = FindWordDocumentFreqs(word);
+        return document_freqs != nullptr && document_freqs->count(document_id) > 0;
     };
-    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), words_checker))
+    if (!MatchesQueryPhrases(query, document_id)
+        || any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), words_checker))
     {
-        return { {}, status };
+        return { vector<string_view>{}, status };
     }
     vector<string_view> matched_words(query.plus_words.size());
     auto words_end = copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), words_checker);
@@ -157,10 +503,75 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     return MatchDocument(raw_query, document_id);
 }
 
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(ThreadPoolPolicy, string_view raw_query, int document_id) const
+{
+    const Query query = ParseQuery(raw_query, true);
+    const auto status = documents_.at(document_id).status;
+    auto contains_word = [this, document_id](string_view word)
+    {
+        const auto* document_freqs = FindWordDocumentFreqs(word);
+        return document_freqs != nullptr && document_freqs->count(document_id) > 0;
+    };
+
+    if (!MatchesQueryPhrases(query, document_id))
+    {
+        return { vector<string_view>{}, status };
+    }
+    ThreadPool& thread_pool = GetThreadPool();
+    atomic<bool> has_minus_word = false;
+    thread_pool.ParallelFor(query.minus_words.size(), [&](size_t i)
+        {
+            if (!has_minus_word.load(memory_order_relaxed) && contains_word(query.minus_words[i]))
+            {
+                has_minus_word = true;
+            }
+        });
+    if (has_minus_word)
+    {
+        return { vector<string_view>{}, status };
+    }
+    vector<char> is_matched(query.plus_words.size());
+    thread_pool.ParallelFor(query.plus_words.size(), [&](size_t i)
+        {
+            is_matched[i] = contains_word(query.plus_words[i]);
+        });
+    vector<string_view> matched_words;
+    for (size_t i = 0; i < query.plus_words.size(); ++i)
+    {
+        if (is_matched[i])
+        {
+            matched_words.push_back(query.plus_words[i]);
+        }
+    }
+    sort(matched_words.begin(), matched_words.end());
+    matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    return { matched_words, status };
+}
+
+void SearchServer::SetThreadPoolOptions(const ThreadPoolOptions& options)
+{
+    atomic_store(&thread_pool_, make_shared<ThreadPool>(options));
+}
+
+ThreadPool& SearchServer::GetThreadPool() const
+{
+    auto thread_pool = atomic_load(&thread_pool_);
+    if (!thread_pool)
+    {
+        // Concurrent first calls race to start the pool, the pools of the losers are dropped
+        auto started_pool = make_shared<ThreadPool>();
+        if (atomic_compare_exchange_strong(&thread_pool_, &thread_pool, started_pool))
+        {
+            thread_pool = move(started_pool);
+        }
+    }
+    return *thread_pool;
+}
+
 
 bool SearchServer::IsStopWord(string_view word) const
 {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(string_view word)
@@ -211,31 +622,102 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
         is_minus = true;
         word = word.substr(1);
     }
+    bool is_prefix = false;
+    if (!word.empty() && word.back() == '*')
+    {
+        is_prefix = true;
+        word.remove_suffix(1);
+    }
     if (word.empty() || word[0] == '-' || !IsValidWord(word))
     {
         throw invalid_argument("Query word "s + string(text) + " is invalid");
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, !is_prefix && IsStopWord(word), is_prefix };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const string_view text, bool skip_sort) const
+SearchServer::Query SearchServer::ParseQuery(const string_view text, bool skip_sort, const PrefixExpansions* prefix_expansions) const
 {
     Query result;
+    optional<QueryPhrase> phrase;
+    int phrase_offset = 0;
     for (string_view word : SplitIntoWordsView(text))
     {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop)
+        if (!phrase && !word.empty() && word[0] == '"')
+        {
+            phrase.emplace();
+            phrase_offset = 0;
+            word.remove_prefix(1);
+        }
+        bool is_phrase_end = false;
+        if (phrase)
+        {
+            const size_t quote_pos = word.find('"');
+            if (quote_pos != word.npos)
+            {
+                phrase->slop = ParsePhraseSlop(word.substr(quote_pos + 1));
+                word = word.substr(0, quote_pos);
+                is_phrase_end = true;
+            }
+        }
+
+        if (!phrase || !word.empty())
         {
-            if (query_word.is_minus)
+            const auto query_word = ParseQueryWord(word);
+            if (phrase && query_word.is_minus)
             {
-                result.minus_words.push_back(query_word.data);
+                throw invalid_argument("Phrase word "s + string(word) + " can not be a minus word"s);
             }
-            else
+            if (phrase && query_word.is_prefix)
             {
-                result.plus_words.push_back(query_word.data);
+                throw invalid_argument("Phrase word "s + string(word) + " can not be a prefix"s);
             }
+            if (query_word.is_prefix)
+            {
+                auto& words = query_word.is_minus ? result.minus_words : result.plus_words;
+                const size_t first_word = words.size();
+                if (prefix_expansions == nullptr)
+                {
+                    ExpandPrefixWord(query_word.data, words);
+                }
+                else if (const auto it = prefix_expansions->find(query_word.data); it != prefix_expansions->end())
+                {
+                    words.insert(words.end(), it->second.begin(), it->second.end());
+                }
+                result.prefix_expansions.try_emplace(query_word.data, words.begin() + first_word, words.end());
+            }
+            else if (!query_word.is_stop)
+            {
+                if (query_word.is_minus)
+                {
+                    result.minus_words.push_back(query_word.data);
+                }
+                else
+                {
+                    result.plus_words.push_back(query_word.data);
+                }
+                if (phrase)
+                {
+                    phrase->words.push_back(query_word.data);
+                    phrase->offsets.push_back(phrase_offset);
+                }
+            }
+            ++phrase_offset;
         }
+
+        if (is_phrase_end)
+        {
+            // A single word phrase is just a plus word
+            if (phrase->words.size() > 1)
+            {
+                result.phrases.push_back(move(*phrase));
+            }
+            phrase.reset();
+        }
+    }
+    if (phrase)
+    {
+        throw invalid_argument("Query phrase is not closed"s);
     }
     if (!skip_sort)
     {
@@ -251,7 +733,152 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, bool skip_s
 
 double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const
 {
-    return log(GetDocumentCount() * 1.0 / (*word_to_document_freqs_.find(word)).second.size());
+    return log(GetDocumentCount() * 1.0 / FindWordDocumentFreqs(word)->size());
+}
+
+shared_ptr<const SearchServer::DocumentIdQuantiles> SearchServer::GetDocumentIdQuantiles() const
+{
+    auto quantiles = atomic_load(&document_id_quantiles_);
+    if (quantiles && !quantiles->ids.empty()
+        && index_generation_ - quantiles->index_generation <= document_ids_.size() / 8)
+    {
+        return quantiles;
+    }
+    // Concurrent queries may each build them, the last one stays
+    auto built_quantiles = make_shared<DocumentIdQuantiles>();
+    built_quantiles->index_generation = index_generation_;
+    const size_t step = max<size_t>(1, document_ids_.size() / DOCUMENT_ID_QUANTILE_COUNT);
+    built_quantiles->ids.reserve(document_ids_.size() / step + 1);
+    size_t position = 0;
+    for (int document_id : document_ids_)
+    {
+        if (position++ % step == 0)
+        {
+            built_quantiles->ids.push_back(document_id);
+        }
+    }
+    atomic_store(&document_id_quantiles_, shared_ptr<const DocumentIdQuantiles>(built_quantiles));
+    return built_quantiles;
+}
+
+const SearchServer::DocumentPostings* SearchServer::FindWordDocumentFreqs(string_view word) const
+{
+    if (!term_filter_.MayContain(word))
+    {
+        return nullptr;
+    }
+    const optional<TermId> term_id = term_dictionary_.Find(word);
+    return term_id ? &word_to_document_freqs_.at(*term_id) : nullptr;
+}
+
+void SearchServer::AddTermFilterWord(string_view word)
+{
+    if (term_filter_.GetTermCount() < term_filter_.GetCapacity())
+    {
+        term_filter_.Add(word);
+    }
+    else
+    {
+        // The word is in the dictionary already, so the rebuilt filter has it
+        RebuildTermFilter();
+    }
+}
+
+void SearchServer::RebuildTermFilter()
+{
+    TermFilter term_filter(max<size_t>(MIN_TERM_FILTER_CAPACITY, 2 * term_dictionary_.size()));
+    term_dictionary_.VisitPrefix({}, term_dictionary_.size(), [&term_filter](TermId, string_view word)
+        {
+            term_filter.Add(word);
+        });
+    term_filter_ = move(term_filter);
+}
+
+void SearchServer::ExpandPrefixWord(string_view prefix, vector<string_view>& words) const
+{
+    term_dictionary_.VisitPrefix(prefix, MAX_PREFIX_EXPANSION_COUNT, [&words](TermId, string_view word)
+        {
+            words.push_back(word);
+        });
+}
+
+int SearchServer::FindPhraseGap(const QueryPhrase& phrase, int document_id) const
+{
+    vector<vector<int>> word_positions;
+    word_positions.reserve(phrase.words.size());
+    for (string_view word : phrase.words)
+    {
+        const optional<TermId> term_id = term_dictionary_.Find(word);
+        const auto word_it = term_id ? word_to_document_positions_.find(*term_id) : word_to_document_positions_.end();
+        if (word_it == word_to_document_positions_.end())
+        {
+            return -1;
+        }
+        const auto document_it = word_it->second.find(document_id);
+        if (document_it == word_it->second.end())
+        {
+            return -1;
+        }
+        word_positions.push_back(DecodePositions(document_it->second));
+    }
+
+    // Taking the earliest suitable position of every next word gives the tightest match for a start
+    int best_gap = -1;
+    for (int start : word_positions[0])
+    {
+        int previous = start;
+        int gap = 0;
+        for (size_t i = 1; i < word_positions.size() && gap <= phrase.slop; ++i)
+        {
+            const int expected_distance = phrase.offsets[i] - phrase.offsets[i - 1];
+            const auto it = lower_bound(word_positions[i].begin(), word_positions[i].end(), previous + expected_distance);
+            if (it == word_positions[i].end())
+            {
+                return best_gap;
+            }
+            gap += *it - previous - expected_distance;
+            previous = *it;
+        }
+        if (gap <= phrase.slop && (best_gap < 0 || gap < best_gap))
+        {
+            best_gap = gap;
+        }
+        if (best_gap == 0)
+        {
+            break;
+        }
+    }
+    return best_gap;
+}
+
+bool SearchServer::MatchesQueryPhrases(const Query& query, int document_id) const
+{
+    if (!query.phrases.empty() && !is_positional_index_enabled_)
+    {
+        throw invalid_argument("Phrase queries need the positional index"s);
+    }
+    return all_of(query.phrases.begin(), query.phrases.end(), [&](const QueryPhrase& phrase)
+        {
+            return FindPhraseGap(phrase, document_id) >= 0;
+        });
+}
+
+void SearchServer::ApplyQueryPhrases(const Query& query, vector<Document>& matched_documents) const
+{
+    const auto it = remove_if(matched_documents.begin(), matched_documents.end(), [&](Document& document)
+        {
+            for (const QueryPhrase& phrase : query.phrases)
+            {
+                const int gap = FindPhraseGap(phrase, document.id);
+                if (gap < 0)
+                {
+                    return true;
+                }
+                document.relevance *= 1.0 + PHRASE_PROXIMITY_BOOST / (1 + gap);
+            }
+            return false;
+        });
+    matched_documents.erase(it, matched_documents.end());
 }
 
 void PrintMatchDocumentResult(int document_id, const vector<string_view>& words, DocumentStatus status) {
@@ -0,0 +1,42 @@
+#include "search_server.h"
+#include "shard_rpc.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace std;
+
+// search_server_shard <socket path> <stop words> <ready fd>
+// Serves an empty SearchServer on the socket. Started by ShardProcess, which waits for a byte on
+// the ready descriptor before it connects.
+int main(int argc, char* argv[])
+{
+    if (argc != 4)
+    {
+        cerr << "Usage: "s << argv[0] << " <socket path> <stop words> <ready fd>"s << endl;
+        return 2;
+    }
+    const int ready_fd = atoi(argv[3]);
+    try
+    {
+        const string stop_words_text = argv[2];
+        SearchServer search_server(stop_words_text);
+        ShardRpcServer rpc_server(argv[1], search_server);
+        const char ready = 1;
+        if (write(ready_fd, &ready, 1) != 1)
+        {
+            return 1;
+        }
+        close(ready_fd);
+        rpc_server.Serve();
+    }
+    catch (const exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1057 @@
+#include "shard_rpc.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <optional>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+
+enum class RpcOpcode : uint8_t
+{
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT,
+    QUERY_TERM_STATISTICS,
+    FIND_TOP_DOCUMENTS,
+    MATCH_DOCUMENT,
+};
+
+enum class RpcStatus : uint8_t
+{
+    OK,
+    INVALID_ARGUMENT,
+    OUT_OF_RANGE,
+    INTERNAL_ERROR,
+};
+
+struct RpcFrameHeader
+{
+    uint32_t payload_size;
+    uint32_t request_id;
+    RpcOpcode opcode;
+    RpcStatus status;
+    uint16_t reserved;
+};
+
+const size_t MAX_PAYLOAD_SIZE = 64u << 20;
+const size_t MAX_IN_FLIGHT_REQUESTS = 64;
+const int SERVER_POLL_INTERVAL_MS = 100;
+
+system_error MakeSystemError(const char* what)
+{
+    return system_error(errno, generic_category(), what);
+}
+
+sockaddr_un MakeSocketAddress(const string& socket_path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        throw invalid_argument("Socket path "s + socket_path + " is too long"s);
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+// Milliseconds left until the deadline for poll, rounded up
+int GetPollTimeout(chrono::steady_clock::time_point deadline)
+{
+    const auto timeout = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count() + 1;
+    return static_cast<int>(clamp<int64_t>(timeout, 0, INT_MAX));
+}
+
+// A non-blocking socket is waited for until the deadline; returns false if it passes first
+bool WriteAll(int fd, vector<iovec>& iov, chrono::steady_clock::time_point deadline)
+{
+    size_t first = 0;
+    while (first < iov.size())
+    {
+        msghdr message{};
+        message.msg_iov = iov.data() + first;
+        message.msg_iovlen = min<size_t>(iov.size() - first, IOV_MAX);
+        const ssize_t written = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            pollfd writable{ fd, POLLOUT, 0 };
+            if (chrono::steady_clock::now() >= deadline
+                || (poll(&writable, 1, GetPollTimeout(deadline)) < 0 && errno != EINTR))
+            {
+                return false;
+            }
+            continue;
+        }
+        for (size_t left = static_cast<size_t>(written); left > 0;)
+        {
+            const size_t step = min(left, iov[first].iov_len);
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + step;
+            iov[first].iov_len -= step;
+            left -= step;
+            if (iov[first].iov_len == 0)
+            {
+                ++first;
+            }
+        }
+        while (first < iov.size() && iov[first].iov_len == 0)
+        {
+            ++first;
+        }
+    }
+    return true;
+}
+
+// Scalars are copied into a small scratch buffer, strings are referenced in place;
+// the frame goes out with a single gathered write
+class FrameWriter
+{
+public:
+    template <typename T>
+    void Put(T value)
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        if (segments_.empty() || segments_.back().external != nullptr)
+        {
+            segments_.push_back({ nullptr, scratch_.size(), 0 });
+        }
+        scratch_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        segments_.back().size += sizeof(value);
+    }
+
+    void PutString(string_view str)
+    {
+        Put(static_cast<uint32_t>(str.size()));
+        if (!str.empty())
+        {
+            segments_.push_back({ str.data(), 0, str.size() });
+        }
+    }
+
+    // Returns false if the peer is gone or does not take the frame before the deadline
+    bool Send(int fd, RpcOpcode opcode, RpcStatus status, uint32_t request_id,
+        chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max()) const
+    {
+        RpcFrameHeader header{ 0, request_id, opcode, status, 0 };
+        vector<iovec> iov;
+        iov.reserve(segments_.size() + 1);
+        iov.push_back({ &header, sizeof(header) });
+        for (const auto& segment : segments_)
+        {
+            const char* data = segment.external != nullptr ? segment.external : scratch_.data() + segment.offset;
+            iov.push_back({ const_cast<char*>(data), segment.size });
+            header.payload_size += static_cast<uint32_t>(segment.size);
+        }
+        return WriteAll(fd, iov, deadline);
+    }
+
+private:
+    struct Segment
+    {
+        const char* external;
+        size_t offset;
+        size_t size;
+    };
+
+    string scratch_;
+    vector<Segment> segments_;
+};
+
+class PayloadReader
+{
+public:
+    explicit PayloadReader(string_view payload)
+        : payload_(payload)
+    {
+
+    }
+
+    template <typename T>
+    T Get()
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        if (payload_.size() < sizeof(T))
+        {
+            throw runtime_error("Malformed shard frame"s);
+        }
+        T value;
+        memcpy(&value, payload_.data(), sizeof(value));
+        payload_.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    string_view GetString()
+    {
+        const size_t size = Get<uint32_t>();
+        if (payload_.size() < size)
+        {
+            throw runtime_error("Malformed shard frame"s);
+        }
+        const string_view result = payload_.substr(0, size);
+        payload_.remove_prefix(size);
+        return result;
+    }
+
+    // Element count announced by the peer, checked against the bytes actually left
+    size_t GetCount(size_t min_element_size)
+    {
+        const size_t count = Get<uint32_t>();
+        if (count > payload_.size() / min_element_size)
+        {
+            throw runtime_error("Malformed shard frame"s);
+        }
+        return count;
+    }
+
+private:
+    string_view payload_;
+};
+
+// Accumulates bytes read from a socket and cuts them into frames. Payload views point into the
+// buffer and stay valid until the next ReadFrom.
+class FrameBuffer
+{
+public:
+    // Returns false at the end of the stream or on an error
+    bool ReadFrom(int fd)
+    {
+        if (begin_ > 0 && (begin_ == end_ || end_ == data_.size()))
+        {
+            memmove(data_.data(), data_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == data_.size())
+        {
+            data_.resize(max<size_t>(4096, data_.size() * 2));
+        }
+        ssize_t read_size;
+        do
+        {
+            read_size = read(fd, data_.data() + end_, data_.size() - end_);
+        } while (read_size < 0 && errno == EINTR);
+        if (read_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (read_size <= 0)
+        {
+            return false;
+        }
+        end_ += static_cast<size_t>(read_size);
+        return true;
+    }
+
+    bool NextFrame(RpcFrameHeader& header, string_view& payload)
+    {
+        if (end_ - begin_ < sizeof(header))
+        {
+            return false;
+        }
+        memcpy(&header, data_.data() + begin_, sizeof(header));
+        if (header.payload_size > MAX_PAYLOAD_SIZE)
+        {
+            throw runtime_error("Shard frame is too large"s);
+        }
+        const size_t frame_size = sizeof(header) + header.payload_size;
+        if (end_ - begin_ < frame_size)
+        {
+            return false;
+        }
+        payload = string_view(data_.data() + begin_ + sizeof(header), header.payload_size);
+        begin_ += frame_size;
+        return true;
+    }
+
+private:
+    vector<char> data_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+void PutPrefixExpansions(FrameWriter& writer, const PrefixExpansions& prefix_expansions)
+{
+    writer.Put(static_cast<uint32_t>(prefix_expansions.size()));
+    for (const auto& [prefix, words] : prefix_expansions)
+    {
+        writer.PutString(prefix);
+        writer.Put(static_cast<uint32_t>(words.size()));
+        for (string_view word : words)
+        {
+            writer.PutString(word);
+        }
+    }
+}
+
+// The words view the payload
+PrefixExpansions GetPrefixExpansions(PayloadReader& reader)
+{
+    PrefixExpansions prefix_expansions;
+    for (size_t i = reader.GetCount(2 * sizeof(uint32_t)); i > 0; --i)
+    {
+        auto& words = prefix_expansions[reader.GetString()];
+        words.resize(reader.GetCount(sizeof(uint32_t)));
+        for (string_view& word : words)
+        {
+            word = reader.GetString();
+        }
+    }
+    return prefix_expansions;
+}
+
+void PutQueryTermStatistics(FrameWriter& writer, const QueryTermStatistics& statistics)
+{
+    writer.Put(static_cast<int32_t>(statistics.document_count));
+    writer.Put(static_cast<uint32_t>(statistics.word_document_counts.size()));
+    for (const auto& [word, count] : statistics.word_document_counts)
+    {
+        writer.PutString(word);
+        writer.Put(static_cast<int32_t>(count));
+    }
+    PutPrefixExpansions(writer, statistics.prefix_expansions);
+}
+
+QueryTermStatistics GetQueryTermStatistics(PayloadReader& reader)
+{
+    QueryTermStatistics statistics;
+    statistics.document_count = reader.Get<int32_t>();
+    for (size_t i = reader.GetCount(sizeof(uint32_t) + sizeof(int32_t)); i > 0; --i)
+    {
+        const string_view word = reader.GetString();
+        statistics.word_document_counts[word] = reader.Get<int32_t>();
+    }
+    statistics.prefix_expansions = GetPrefixExpansions(reader);
+    return statistics;
+}
+
+void HandleRequest(SearchServer& search_server, PayloadReader& request, RpcOpcode opcode, FrameWriter& response)
+{
+    switch (opcode)
+    {
+    case RpcOpcode::ADD_DOCUMENT:
+    {
+        const int document_id = request.Get<int32_t>();
+        const auto status = static_cast<DocumentStatus>(request.Get<uint8_t>());
+        vector<int> ratings(request.GetCount(sizeof(int32_t)));
+        for (int& rating : ratings)
+        {
+            rating = request.Get<int32_t>();
+        }
+        search_server.AddDocument(document_id, request.GetString(), status, ratings);
+        break;
+    }
+    case RpcOpcode::REMOVE_DOCUMENT:
+        search_server.RemoveDocument(request.Get<int32_t>());
+        break;
+    case RpcOpcode::QUERY_TERM_STATISTICS:
+        PutQueryTermStatistics(response, as_const(search_server).GetQueryTermStatistics(request.GetString()));
+        break;
+    case RpcOpcode::FIND_TOP_DOCUMENTS:
+    {
+        const auto status = static_cast<DocumentStatus>(request.Get<uint8_t>());
+        const string_view raw_query = request.GetString();
+        map<string_view, double> inverse_document_freqs;
+        for (size_t i = request.GetCount(sizeof(uint32_t) + sizeof(double)); i > 0; --i)
+        {
+            const string_view word = request.GetString();
+            inverse_document_freqs[word] = request.Get<double>();
+        }
+        const PrefixExpansions prefix_expansions = GetPrefixExpansions(request);
+        const SearchServer& server = search_server;
+        const auto documents = server.FindTopDocuments(execution::seq, raw_query, DocumentStatusPredicate{ status },
+            [&](string_view word)
+            {
+                const auto it = inverse_document_freqs.find(word);
+                if (it != inverse_document_freqs.end())
+                {
+                    return it->second;
+                }
+                return log(server.GetDocumentCount() * 1.0 / server.GetWordDocumentCount(word));
+            }, prefix_expansions);
+        response.Put(static_cast<uint32_t>(documents.size()));
+        for (const Document& document : documents)
+        {
+            response.Put(static_cast<int32_t>(document.id));
+            response.Put(document.relevance);
+            response.Put(static_cast<int32_t>(document.rating));
+        }
+        break;
+    }
+    case RpcOpcode::MATCH_DOCUMENT:
+    {
+        const int document_id = request.Get<int32_t>();
+        const string_view raw_query = request.GetString();
+        const auto [words, status] = as_const(search_server).MatchDocument(raw_query, document_id);
+        // Prefix words match words of the index, so the words are sent by value
+        response.Put(static_cast<uint8_t>(status));
+        response.Put(static_cast<uint32_t>(words.size()));
+        for (string_view word : words)
+        {
+            response.PutString(word);
+        }
+        break;
+    }
+    default:
+        throw invalid_argument("Unknown shard request"s);
+    }
+}
+
+// Returns false if the response could not be sent
+bool ServeRequest(SearchServer& search_server, int fd, const RpcFrameHeader& header, string_view payload)
+{
+    FrameWriter response;
+    RpcStatus status = RpcStatus::OK;
+    string error;
+    try
+    {
+        PayloadReader request(payload);
+        HandleRequest(search_server, request, header.opcode, response);
+    }
+    catch (const invalid_argument& e)
+    {
+        status = RpcStatus::INVALID_ARGUMENT;
+        error = e.what();
+    }
+    catch (const out_of_range& e)
+    {
+        status = RpcStatus::OUT_OF_RANGE;
+        error = e.what();
+    }
+    catch (const exception& e)
+    {
+        status = RpcStatus::INTERNAL_ERROR;
+        error = e.what();
+    }
+    if (status != RpcStatus::OK)
+    {
+        FrameWriter error_response;
+        error_response.PutString(error);
+        return error_response.Send(fd, header.opcode, status, header.request_id);
+    }
+    return response.Send(fd, header.opcode, status, header.request_id);
+}
+
+struct RpcResponse
+{
+    RpcFrameHeader header;
+    string_view payload;
+};
+
+void ThrowIfError(const RpcResponse& response)
+{
+    if (response.header.status == RpcStatus::OK)
+    {
+        return;
+    }
+    PayloadReader reader(response.payload);
+    const string message(reader.GetString());
+    switch (response.header.status)
+    {
+    case RpcStatus::INVALID_ARGUMENT:
+        throw invalid_argument(message);
+    case RpcStatus::OUT_OF_RANGE:
+        throw out_of_range(message);
+    default:
+        throw runtime_error(message);
+    }
+}
+
+bool CompareDocuments(const Document& lhs, const Document& rhs)
+{
+    if (abs(lhs.relevance - rhs.relevance) < EPSILON)
+    {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+}
+
+ShardRpcServer::ShardRpcServer(const string& socket_path, SearchServer& search_server)
+    : socket_path_(socket_path)
+    , search_server_(search_server)
+{
+    const sockaddr_un address = MakeSocketAddress(socket_path_);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0)
+    {
+        throw MakeSystemError("socket");
+    }
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0)
+    {
+        const auto error = MakeSystemError("bind");
+        close(listen_fd_);
+        throw error;
+    }
+}
+
+ShardRpcServer::~ShardRpcServer()
+{
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void ShardRpcServer::Serve()
+{
+    struct Connection
+    {
+        int fd;
+        FrameBuffer buffer;
+    };
+    vector<Connection> connections;
+    vector<pollfd> fds;
+    while (!is_stopped_)
+    {
+        fds.clear();
+        fds.push_back({ listen_fd_, POLLIN, 0 });
+        for (const auto& connection : connections)
+        {
+            fds.push_back({ connection.fd, POLLIN, 0 });
+        }
+        if (poll(fds.data(), fds.size(), SERVER_POLL_INTERVAL_MS) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw MakeSystemError("poll");
+        }
+
+        vector<bool> is_closed(connections.size(), false);
+        for (size_t i = 0; i < connections.size(); ++i)
+        {
+            if (fds[i + 1].revents == 0)
+            {
+                continue;
+            }
+            auto& connection = connections[i];
+            bool is_alive = connection.buffer.ReadFrom(connection.fd);
+            try
+            {
+                RpcFrameHeader header;
+                string_view payload;
+                // Pipelined requests are answered in arrival order
+                while (is_alive && connection.buffer.NextFrame(header, payload))
+                {
+                    is_alive = ServeRequest(search_server_, connection.fd, header, payload);
+                }
+            }
+            catch (const runtime_error&)
+            {
+                is_alive = false;
+            }
+            if (!is_alive)
+            {
+                close(connection.fd);
+                is_closed[i] = true;
+            }
+        }
+        for (size_t i = connections.size(); i > 0; --i)
+        {
+            if (is_closed[i - 1])
+            {
+                connections.erase(connections.begin() + (i - 1));
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                connections.push_back({ fd, FrameBuffer() });
+            }
+        }
+    }
+    for (const auto& connection : connections)
+    {
+        close(connection.fd);
+    }
+}
+
+void ShardRpcServer::Stop()
+{
+    is_stopped_ = true;
+}
+
+ShardProcess::ShardProcess(const string& shard_executable, const string& socket_path, const string& stop_words_text)
+    : socket_path_(socket_path)
+{
+    int ready_pipe[2];
+    if (pipe2(ready_pipe, O_CLOEXEC) != 0)
+    {
+        throw MakeSystemError("pipe");
+    }
+    // Only async-signal-safe calls may run between fork and exec, so everything is prepared here
+    const string ready_fd = to_string(ready_pipe[1]);
+    const vector<char*> arguments = {
+        const_cast<char*>(shard_executable.c_str()),
+        const_cast<char*>(socket_path_.c_str()),
+        const_cast<char*>(stop_words_text.c_str()),
+        const_cast<char*>(ready_fd.c_str()),
+        nullptr,
+    };
+    const pid_t parent_pid = getpid();
+    pid_ = fork();
+    if (pid_ < 0)
+    {
+        const auto error = MakeSystemError("fork");
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
+        throw error;
+    }
+    if (pid_ == 0)
+    {
+        // The shard must not outlive its owner, even if the owner crashes before this line
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent_pid || fcntl(ready_pipe[1], F_SETFD, 0) != 0)
+        {
+            _exit(1);
+        }
+        execv(arguments[0], arguments.data());
+        _exit(127);
+    }
+
+    close(ready_pipe[1]);
+    char ready = 0;
+    ssize_t read_size;
+    do
+    {
+        read_size = read(ready_pipe[0], &ready, 1);
+    } while (read_size < 0 && errno == EINTR);
+    close(ready_pipe[0]);
+    if (read_size != 1)
+    {
+        waitpid(pid_, nullptr, 0);
+        throw runtime_error("Shard process for "s + socket_path_ + " failed to start"s);
+    }
+}
+
+ShardProcess::~ShardProcess()
+{
+    kill(pid_, SIGTERM);
+    waitpid(pid_, nullptr, 0);
+    unlink(socket_path_.c_str());
+}
+
+pid_t ShardProcess::GetPid() const
+{
+    return pid_;
+}
+
+bool ScatterGatherResult::IsPartial() const
+{
+    return answered_shard_count < shard_count;
+}
+
+// The socket is non-blocking, so a shard that stops reading cannot hold a request past its deadline.
+// A broken connection is opened again on the next request, so a restarted shard rejoins.
+class ShardCoordinator::ShardConnection
+{
+public:
+    explicit ShardConnection(const string& socket_path)
+        : socket_path_(socket_path)
+    {
+        Connect();
+    }
+
+    ~ShardConnection()
+    {
+        close(fd_);
+    }
+
+    int GetFd() const
+    {
+        return fd_;
+    }
+
+    // The connection broke, or the request went out on an earlier one
+    bool IsLost(uint32_t request_id) const
+    {
+        return is_broken_ || request_id - first_request_id_ >= next_request_id_ - first_request_id_;
+    }
+
+    // Returns the id to wait the response for
+    uint32_t Send(RpcOpcode opcode, const FrameWriter& request, chrono::steady_clock::time_point deadline)
+    {
+        if (is_broken_)
+        {
+            Reconnect();
+        }
+        const uint32_t request_id = next_request_id_++;
+        if (!request.Send(fd_, opcode, RpcStatus::OK, request_id, deadline))
+        {
+            // The rest of a partly written frame would garble the stream
+            is_broken_ = true;
+            throw runtime_error("Shard is unavailable"s);
+        }
+        return request_id;
+    }
+
+    void ReadAvailable()
+    {
+        if (!buffer_.ReadFrom(fd_))
+        {
+            is_broken_ = true;
+        }
+    }
+
+    // Skips responses to requests that timed out earlier
+    bool TakeResponse(uint32_t request_id, RpcResponse& response)
+    {
+        while (buffer_.NextFrame(response.header, response.payload))
+        {
+            if (response.header.request_id == request_id)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    string socket_path_;
+    int fd_ = -1;
+    uint32_t first_request_id_ = 0;
+    uint32_t next_request_id_ = 0;
+    bool is_broken_ = false;
+    FrameBuffer buffer_;
+
+    void Connect()
+    {
+        const sockaddr_un address = MakeSocketAddress(socket_path_);
+        fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd_ < 0)
+        {
+            throw MakeSystemError("socket");
+        }
+        if (connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            const auto error = MakeSystemError("connect");
+            close(fd_);
+            fd_ = -1;
+            throw error;
+        }
+    }
+
+    void Reconnect()
+    {
+        close(fd_);
+        buffer_ = FrameBuffer();
+        try
+        {
+            Connect();
+        }
+        catch (const system_error&)
+        {
+            throw runtime_error("Shard is unavailable"s);
+        }
+        first_request_id_ = next_request_id_;
+        is_broken_ = false;
+    }
+};
+
+namespace
+{
+
+// Waits for the responses of all requests until the deadline; missing ones stay empty
+template <typename Connection>
+vector<optional<RpcResponse>> GatherResponses(const vector<pair<Connection*, uint32_t>>& requests,
+    chrono::steady_clock::time_point deadline)
+{
+    vector<optional<RpcResponse>> responses(requests.size());
+    vector<pollfd> fds;
+    vector<size_t> waiting;
+    while (true)
+    {
+        fds.clear();
+        waiting.clear();
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            auto& [connection, request_id] = requests[i];
+            if (responses[i] || connection->IsLost(request_id))
+            {
+                continue;
+            }
+            RpcResponse response;
+            if (connection->TakeResponse(request_id, response))
+            {
+                responses[i] = response;
+                continue;
+            }
+            fds.push_back({ connection->GetFd(), POLLIN, 0 });
+            waiting.push_back(i);
+        }
+        if (fds.empty() || chrono::steady_clock::now() >= deadline)
+        {
+            return responses;
+        }
+        if (poll(fds.data(), fds.size(), GetPollTimeout(deadline)) < 0 && errno != EINTR)
+        {
+            throw MakeSystemError("poll");
+        }
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i].revents != 0)
+            {
+                requests[waiting[i]].first->ReadAvailable();
+            }
+        }
+    }
+}
+
+// Sends the request to every shard and waits for the answers until the timeout
+template <typename Connection>
+vector<optional<RpcResponse>> Scatter(const vector<Connection*>& shards, RpcOpcode opcode, const FrameWriter& request,
+    chrono::milliseconds timeout)
+{
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    vector<pair<Connection*, uint32_t>> requests;
+    requests.reserve(shards.size());
+    for (Connection* shard : shards)
+    {
+        uint32_t request_id = 0;
+        try
+        {
+            request_id = shard->Send(opcode, request, deadline);
+        }
+        catch (const runtime_error&)
+        {
+            // A broken shard is skipped and reported through the partial result
+        }
+        requests.push_back({ shard, request_id });
+    }
+    return GatherResponses(requests, deadline);
+}
+
+template <typename Connection>
+RpcResponse Call(Connection& shard, RpcOpcode opcode, const FrameWriter& request, chrono::milliseconds timeout)
+{
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    const uint32_t request_id = shard.Send(opcode, request, deadline);
+    auto responses = GatherResponses(vector<pair<Connection*, uint32_t>>{ { &shard, request_id } }, deadline);
+    if (!responses[0])
+    {
+        throw runtime_error("Shard did not answer in time"s);
+    }
+    ThrowIfError(*responses[0]);
+    return *responses[0];
+}
+
+void PutDocument(FrameWriter& request, int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    request.Put(static_cast<int32_t>(document_id));
+    request.Put(static_cast<uint8_t>(status));
+    request.Put(static_cast<uint32_t>(ratings.size()));
+    for (int rating : ratings)
+    {
+        request.Put(static_cast<int32_t>(rating));
+    }
+    request.PutString(document);
+}
+
+}
+
+ShardCoordinator::ShardCoordinator(const vector<string>& socket_paths, chrono::milliseconds shard_timeout)
+    : shard_timeout_(shard_timeout)
+{
+    if (socket_paths.empty())
+    {
+        throw invalid_argument("Shard count must be positive"s);
+    }
+    shards_.reserve(socket_paths.size());
+    for (const string& socket_path : socket_paths)
+    {
+        shards_.push_back(make_unique<ShardConnection>(socket_path));
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() = default;
+
+void ShardCoordinator::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    FrameWriter request;
+    PutDocument(request, document_id, document, status, ratings);
+    Call(GetShard(document_id), RpcOpcode::ADD_DOCUMENT, request, shard_timeout_);
+}
+
+void ShardCoordinator::AddDocuments(const vector<RemoteDocument>& documents)
+{
+    vector<deque<uint32_t>> in_flight(shards_.size());
+    exception_ptr first_error;
+    auto wait_oldest = [&](size_t shard_index)
+    {
+        const uint32_t request_id = in_flight[shard_index].front();
+        in_flight[shard_index].pop_front();
+        auto responses = GatherResponses(vector<pair<ShardConnection*, uint32_t>>{ { shards_[shard_index].get(), request_id } },
+            chrono::steady_clock::now() + shard_timeout_);
+        try
+        {
+            if (!responses[0])
+            {
+                throw runtime_error("Shard did not answer in time"s);
+            }
+            ThrowIfError(*responses[0]);
+        }
+        catch (...)
+        {
+            if (!first_error)
+            {
+                first_error = current_exception();
+            }
+        }
+    };
+
+    for (const RemoteDocument& document : documents)
+    {
+        const size_t shard_index = static_cast<size_t>(document.id) % shards_.size();
+        FrameWriter request;
+        PutDocument(request, document.id, document.text, document.status, document.ratings);
+        in_flight[shard_index].push_back(shards_[shard_index]->Send(RpcOpcode::ADD_DOCUMENT, request,
+            chrono::steady_clock::now() + shard_timeout_));
+        // Acknowledgements are tiny, a bounded window keeps both socket buffers from filling up
+        if (in_flight[shard_index].size() >= MAX_IN_FLIGHT_REQUESTS)
+        {
+            wait_oldest(shard_index);
+        }
+    }
+    for (size_t i = 0; i < shards_.size(); ++i)
+    {
+        while (!in_flight[i].empty())
+        {
+            wait_oldest(i);
+        }
+    }
+    if (first_error)
+    {
+        rethrow_exception(first_error);
+    }
+}
+
+void ShardCoordinator::RemoveDocument(int document_id)
+{
+    FrameWriter request;
+    request.Put(static_cast<int32_t>(document_id));
+    Call(GetShard(document_id), RpcOpcode::REMOVE_DOCUMENT, request, shard_timeout_);
+}
+
+ScatterGatherResult ShardCoordinator::FindTopDocuments(string_view raw_query, DocumentStatus status)
+{
+    vector<ShardConnection*> shards;
+    for (const auto& shard : shards_)
+    {
+        shards.push_back(shard.get());
+    }
+
+    // The first round collects document frequencies and prefix expansions, the second one ranks
+    // with the global IDF and expansions
+    FrameWriter statistics_request;
+    statistics_request.PutString(raw_query);
+    const auto statistics_responses = Scatter(shards, RpcOpcode::QUERY_TERM_STATISTICS, statistics_request, shard_timeout_);
+
+    // The words view the payloads of the first round, which stay valid until the second round
+    // reads its responses
+    QueryTermStatistics statistics;
+    vector<ShardConnection*> answered_shards;
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        if (!statistics_responses[i])
+        {
+            continue;
+        }
+        ThrowIfError(*statistics_responses[i]);
+        PayloadReader reader(statistics_responses[i]->payload);
+        statistics.Merge(GetQueryTermStatistics(reader));
+        answered_shards.push_back(shards[i]);
+    }
+
+    FrameWriter find_request;
+    find_request.Put(static_cast<uint8_t>(status));
+    find_request.PutString(raw_query);
+    const map<string_view, double> inverse_document_freqs = statistics.ComputeInverseDocumentFreqs();
+    find_request.Put(static_cast<uint32_t>(inverse_document_freqs.size()));
+    for (const auto& [word, inverse_document_freq] : inverse_document_freqs)
+    {
+        find_request.PutString(word);
+        find_request.Put(inverse_document_freq);
+    }
+    PutPrefixExpansions(find_request, statistics.prefix_expansions);
+    const auto find_responses = Scatter(answered_shards, RpcOpcode::FIND_TOP_DOCUMENTS, find_request, shard_timeout_);
+
+    ScatterGatherResult result;
+    result.shard_count = shards_.size();
+    for (const auto& response : find_responses)
+    {
+        if (!response)
+        {
+            continue;
+        }
+        ThrowIfError(*response);
+        ++result.answered_shard_count;
+        PayloadReader reader(response->payload);
+        for (size_t i = reader.GetCount(2 * sizeof(int32_t) + sizeof(double)); i > 0; --i)
+        {
+            Document document;
+            document.id = reader.Get<int32_t>();
+            document.relevance = reader.Get<double>();
+            document.rating = reader.Get<int32_t>();
+            result.documents.push_back(document);
+        }
+    }
+    sort(result.documents.begin(), result.documents.end(), CompareDocuments);
+    if (result.documents.size() > static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT))
+    {
+        result.documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return result;
+}
+
+tuple<vector<string>, DocumentStatus> ShardCoordinator::MatchDocument(string_view raw_query, int document_id)
+{
+    FrameWriter request;
+    request.Put(static_cast<int32_t>(document_id));
+    request.PutString(raw_query);
+    const RpcResponse response = Call(GetShard(document_id), RpcOpcode::MATCH_DOCUMENT, request, shard_timeout_);
+
+    PayloadReader reader(response.payload);
+    const auto status = static_cast<DocumentStatus>(reader.Get<uint8_t>());
+    vector<string> matched_words(reader.GetCount(sizeof(uint32_t)));
+    for (string& word : matched_words)
+    {
+        word = reader.GetString();
+    }
+    return { matched_words, status };
+}
+
+size_t ShardCoordinator::GetShardCount() const
+{
+    return shards_.size();
+}
+
+ShardCoordinator::ShardConnection& ShardCoordinator::GetShard(int document_id)
+{
+    return *shards_[static_cast<size_t>(document_id) % shards_.size()];
+}
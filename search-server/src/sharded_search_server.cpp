@@ -0,0 +1,157 @@
+#include "sharded_search_server.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+ShardedSearchServer::Shard::~Shard()
+{
+    {
+        lock_guard lg(mut_);
+        is_stopped_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+void ShardedSearchServer::Shard::StartWorker(int cpu)
+{
+    worker_ = thread([this]
+        {
+            WorkerLoop();
+        });
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    // Pinning is an optimization only, the shard works unpinned if the CPU is not available
+    pthread_setaffinity_np(worker_.native_handle(), sizeof(cpu_set), &cpu_set);
+#else
+    (void)cpu;
+#endif
+}
+
+void ShardedSearchServer::Shard::WorkerLoop()
+{
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock lock(mut_);
+            cv_.wait(lock, [this]
+                {
+                    return is_stopped_ || !tasks_.empty();
+                });
+            if (tasks_.empty())
+            {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const string& stop_words_text)
+    : ShardedSearchServer(shard_count, SplitIntoWords(stop_words_text))
+{
+
+}
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, string_view stop_words_text)
+    : ShardedSearchServer(shard_count, SplitIntoWords(static_cast<string>(stop_words_text)))
+{
+
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    if ((document_id < 0) || (document_ids_.count(document_id) > 0))
+    {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    GetShard(document_id).Run([document_id, document, status, &ratings](SearchServer& server)
+        {
+            server.AddDocument(document_id, document, status, ratings);
+        }).get();
+    document_ids_.insert(document_id);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const
+{
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status });
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const
+{
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const
+{
+    return GetShard(document_id).Run([raw_query, document_id](SearchServer& server)
+        {
+            return as_const(server).MatchDocument(raw_query, document_id);
+        }).get();
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id)
+{
+    if (document_ids_.count(document_id) == 0)
+    {
+        return;
+    }
+    GetShard(document_id).Run([document_id](SearchServer& server)
+        {
+            server.RemoveDocument(document_id);
+        }).get();
+    document_ids_.erase(document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const
+{
+    return static_cast<int>(document_ids_.size());
+}
+
+size_t ShardedSearchServer::GetShardCount() const
+{
+    return shards_.size();
+}
+
+set<int>::const_iterator ShardedSearchServer::begin() const
+{
+    return document_ids_.begin();
+}
+
+set<int>::const_iterator ShardedSearchServer::end() const
+{
+    return document_ids_.end();
+}
+
+ShardedSearchServer::Shard& ShardedSearchServer::GetShard(int document_id) const
+{
+    return *shards_[static_cast<size_t>(document_id) % shards_.size()];
+}
+
+QueryTermStatistics ShardedSearchServer::GetQueryTermStatistics(string_view raw_query) const
+{
+    vector<future<QueryTermStatistics>> shard_statistics;
+    shard_statistics.reserve(shards_.size());
+    for (const auto& shard : shards_)
+    {
+        shard_statistics.push_back(shard->Run([raw_query](SearchServer& server)
+            {
+                return as_const(server).GetQueryTermStatistics(raw_query);
+            }));
+    }
+    // The words view the shards' indexes, which do not change while a query runs
+    QueryTermStatistics statistics;
+    for (const auto& other : GetAll(shard_statistics))
+    {
+        statistics.Merge(other);
+    }
+    return statistics;
+}
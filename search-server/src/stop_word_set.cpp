@@ -0,0 +1,121 @@
+#include "stop_word_set.h"
+#include "string_processing.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+
+// Maps a 32-bit value onto [0, count) without a division
+size_t ReduceRange(uint32_t value, size_t count)
+{
+    return static_cast<size_t>((static_cast<uint64_t>(value) * count) >> 32);
+}
+
+}
+
+StopWordSet::StopWordSet(const set<string, less<>>& words)
+    : words_(words.size())
+    , bucket_seeds_((words.size() + BUCKET_SIZE - 1) / BUCKET_SIZE)
+{
+    vector<vector<pair<uint64_t, const string*>>> buckets(bucket_seeds_.size());
+    for (const string& word : words)
+    {
+        const uint64_t hash = HashWord(word);
+        buckets[GetBucket(hash)].emplace_back(hash, &word);
+    }
+    vector<size_t> bucket_order(buckets.size());
+    for (size_t i = 0; i < bucket_order.size(); ++i)
+    {
+        bucket_order[i] = i;
+    }
+    // The largest buckets are placed first, while most slots are still free
+    stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](size_t lhs, size_t rhs)
+        {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+    vector<bool> is_slot_taken(words_.size());
+    vector<size_t> slots;
+    for (const size_t bucket : bucket_order)
+    {
+        if (buckets[bucket].empty())
+        {
+            break;
+        }
+        for (uint32_t seed = 0;; ++seed)
+        {
+            slots.clear();
+            for (const auto& [hash, word] : buckets[bucket])
+            {
+                const size_t slot = GetSlot(hash, seed);
+                if (is_slot_taken[slot] || find(slots.begin(), slots.end(), slot) != slots.end())
+                {
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (slots.size() == buckets[bucket].size())
+            {
+                bucket_seeds_[bucket] = seed;
+                break;
+            }
+        }
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            is_slot_taken[slots[i]] = true;
+            words_[slots[i]] = *buckets[bucket][i].second;
+        }
+    }
+}
+
+bool StopWordSet::Contains(string_view word) const
+{
+    if (words_.empty())
+    {
+        return false;
+    }
+    const uint64_t hash = HashWord(word);
+    return words_[GetSlot(hash, bucket_seeds_[GetBucket(hash)])] == word;
+}
+
+size_t StopWordSet::size() const
+{
+    return words_.size();
+}
+
+vector<string>::const_iterator StopWordSet::begin() const
+{
+    return words_.begin();
+}
+
+vector<string>::const_iterator StopWordSet::end() const
+{
+    return words_.end();
+}
+
+size_t StopWordSet::GetMemoryUsage() const
+{
+    size_t bytes = words_.capacity() * sizeof(string) + bucket_seeds_.capacity() * sizeof(uint32_t);
+    for (const string& word : words_)
+    {
+        // Short words are kept inside the string itself
+        if (word.capacity() > string().capacity())
+        {
+            bytes += word.capacity() + 1;
+        }
+    }
+    return bytes;
+}
+
+size_t StopWordSet::GetBucket(uint64_t hash) const
+{
+    return ReduceRange(static_cast<uint32_t>(hash >> 32), bucket_seeds_.size());
+}
+
+size_t StopWordSet::GetSlot(uint64_t hash, uint32_t seed) const
+{
+    return ReduceRange(static_cast<uint32_t>(MixHash(hash + seed * 0x9e3779b97f4a7c15ull)), words_.size());
+}
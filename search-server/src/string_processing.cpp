@@ -1,6 +1,8 @@
 #include "string_processing.h"
 #include "read_input_functions.h"
 
+#include <cstring>
+
 using namespace std;
 
 vector<string> SplitIntoWords(const string& text)
@@ -44,3 +46,33 @@ vector<string_view> SplitIntoWordsView(string_view str) {
 
     return result;
 }
+
+uint64_t MixHash(uint64_t hash)
+{
+    // Finalizer of MurmurHash3
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+uint64_t HashWord(string_view word)
+{
+    // Eight bytes at a time; words are short, so this is a couple of multiplications
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ word.size();
+    size_t pos = 0;
+    for (; pos + sizeof(uint64_t) <= word.size(); pos += sizeof(uint64_t))
+    {
+        uint64_t chunk;
+        memcpy(&chunk, word.data() + pos, sizeof(chunk));
+        hash = MixHash(hash ^ chunk);
+    }
+    uint64_t tail = 0;
+    if (pos < word.size())
+    {
+        memcpy(&tail, word.data() + pos, word.size() - pos);
+    }
+    return MixHash(hash ^ tail);
+}
@@ -0,0 +1,194 @@
+#include "term_dictionary.h"
+
+#include <cstring>
+#include <functional>
+
+using namespace std;
+
+TermDictionary::TermDictionary(const vector<string_view>& sorted_terms)
+{
+    terms_.reserve(sorted_terms.size());
+    for (string_view term : sorted_terms)
+    {
+        terms_.push_back(StoreTerm(term));
+    }
+    is_removed_.assign(terms_.size(), false);
+    term_count_ = terms_.size();
+    sorted_ids_.resize(terms_.size());
+    for (size_t i = 0; i < sorted_ids_.size(); ++i)
+    {
+        sorted_ids_[i] = static_cast<TermId>(i);
+    }
+    Rehash(term_count_);
+}
+
+size_t TermDictionary::size() const
+{
+    return term_count_;
+}
+
+size_t TermDictionary::GetIdBound() const
+{
+    return terms_.size();
+}
+
+optional<TermDictionary::TermId> TermDictionary::Find(string_view term) const
+{
+    if (slots_.empty())
+    {
+        return nullopt;
+    }
+    const TermId id = slots_[FindSlot(term)];
+    return id == EMPTY_SLOT ? nullopt : optional<TermId>(id);
+}
+
+string_view TermDictionary::GetTerm(TermId id) const
+{
+    return terms_[id];
+}
+
+TermDictionary::TermId TermDictionary::Add(string_view term)
+{
+    if ((used_slot_count_ + 1) * 4 > slots_.size() * 3)
+    {
+        Rehash(term_count_ + 1);
+    }
+    TermId id = 0;
+    if (!free_ids_.empty())
+    {
+        id = free_ids_.back();
+        terms_[id] = StoreTerm(term);
+        is_removed_[id] = false;
+        free_ids_.pop_back();
+    }
+    else
+    {
+        id = static_cast<TermId>(terms_.size());
+        terms_.push_back(StoreTerm(term));
+        is_removed_.push_back(false);
+    }
+    InsertSlot(id);
+    ++term_count_;
+    added_terms_.emplace(terms_[id], id);
+    MergeIfNeeded();
+    return id;
+}
+
+void TermDictionary::Remove(TermId id)
+{
+    slots_[FindSlot(terms_[id])] = REMOVED_SLOT;
+    is_removed_[id] = true;
+    --term_count_;
+    // A term added since the last merge is not among the sorted ids, so its id is free at once
+    if (const auto it = added_terms_.find(terms_[id]); it != added_terms_.end() && it->second == id)
+    {
+        added_terms_.erase(it);
+        free_ids_.push_back(id);
+        return;
+    }
+    removed_ids_.push_back(id);
+    MergeIfNeeded();
+}
+
+size_t TermDictionary::GetMemoryUsage() const
+{
+    // A map node holds the entry and three pointers and a color next to it
+    const size_t added_term_bytes = added_terms_.size() * (sizeof(pair<const string_view, TermId>) + 4 * sizeof(void*));
+    return sizeof(*this) + chunk_bytes_ + chunks_.capacity() * sizeof(chunks_[0]) + terms_.capacity() * sizeof(string_view)
+        + is_removed_.capacity() / 8 + (free_ids_.capacity() + slots_.capacity() + sorted_ids_.capacity() + removed_ids_.capacity()) * sizeof(TermId)
+        + added_term_bytes;
+}
+
+string_view TermDictionary::StoreTerm(string_view term)
+{
+    if (term.size() > chunk_size_ - chunk_used_)
+    {
+        // Chunks grow with the dictionary, so a small one wastes little and a large one needs few
+        const size_t chunk_size = max(term.size(), clamp(chunk_bytes_, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE));
+        chunks_.push_back(make_unique<char[]>(chunk_size));
+        chunk_bytes_ += chunk_size;
+        chunk_size_ = chunk_size;
+        chunk_used_ = 0;
+    }
+    char* data = chunks_.back().get() + chunk_used_;
+    memcpy(data, term.data(), term.size());
+    chunk_used_ += term.size();
+    return { data, term.size() };
+}
+
+size_t TermDictionary::FindSlot(string_view term) const
+{
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = hash<string_view>()(term) & mask;; slot = (slot + 1) & mask)
+    {
+        const TermId id = slots_[slot];
+        if (id == EMPTY_SLOT || (id != REMOVED_SLOT && terms_[id] == term))
+        {
+            return slot;
+        }
+    }
+}
+
+void TermDictionary::InsertSlot(TermId id)
+{
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = hash<string_view>()(terms_[id]) & mask;; slot = (slot + 1) & mask)
+    {
+        if (slots_[slot] == EMPTY_SLOT || slots_[slot] == REMOVED_SLOT)
+        {
+            used_slot_count_ += slots_[slot] == EMPTY_SLOT;
+            slots_[slot] = id;
+            return;
+        }
+    }
+}
+
+void TermDictionary::Rehash(size_t term_count)
+{
+    // At most half of the slots are taken after a rehash
+    size_t slot_count = MIN_SLOT_COUNT;
+    while (slot_count < 2 * term_count)
+    {
+        slot_count *= 2;
+    }
+    slots_.assign(slot_count, EMPTY_SLOT);
+    used_slot_count_ = 0;
+    for (size_t id = 0; id < terms_.size(); ++id)
+    {
+        if (!is_removed_[id])
+        {
+            InsertSlot(static_cast<TermId>(id));
+        }
+    }
+}
+
+void TermDictionary::MergeIfNeeded()
+{
+    if (added_terms_.size() + removed_ids_.size() < max(MIN_MERGE_SIZE, sorted_ids_.size() / 8))
+    {
+        return;
+    }
+    vector<TermId> merged;
+    merged.reserve(term_count_);
+    auto added_it = added_terms_.begin();
+    for (TermId id : sorted_ids_)
+    {
+        if (is_removed_[id])
+        {
+            continue;
+        }
+        for (; added_it != added_terms_.end() && added_it->first < terms_[id]; ++added_it)
+        {
+            merged.push_back(added_it->second);
+        }
+        merged.push_back(id);
+    }
+    for (; added_it != added_terms_.end(); ++added_it)
+    {
+        merged.push_back(added_it->second);
+    }
+    free_ids_.insert(free_ids_.end(), removed_ids_.begin(), removed_ids_.end());
+    sorted_ids_ = move(merged);
+    added_terms_.clear();
+    removed_ids_.clear();
+}
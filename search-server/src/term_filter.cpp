@@ -0,0 +1,79 @@
+#include "term_filter.h"
+#include "string_processing.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+
+// Odd multipliers of the split block Bloom filter of Apache Parquet, one per lane
+const uint32_t LANE_SALTS[8] = { 0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u };
+
+}
+
+TermFilter::TermFilter(size_t capacity)
+    : blocks_(max<size_t>(1, (capacity * BITS_PER_TERM + 255) / 256), Block{})
+    , capacity_(capacity)
+{
+}
+
+void TermFilter::Add(string_view term)
+{
+    const uint64_t hash = HashWord(term);
+    const Block mask = MakeMask(hash);
+    Block& block = blocks_[GetBlockIndex(hash)];
+    for (size_t i = 0; i < mask.lanes.size(); ++i)
+    {
+        block.lanes[i] |= mask.lanes[i];
+    }
+    ++term_count_;
+}
+
+bool TermFilter::MayContain(string_view term) const
+{
+    const uint64_t hash = HashWord(term);
+    const Block mask = MakeMask(hash);
+    const Block& block = blocks_[GetBlockIndex(hash)];
+    bool is_present = true;
+    // No early exit, the eight lanes are checked as a vector
+    for (size_t i = 0; i < mask.lanes.size(); ++i)
+    {
+        is_present &= (block.lanes[i] & mask.lanes[i]) != 0;
+    }
+    return is_present;
+}
+
+size_t TermFilter::GetCapacity() const
+{
+    return capacity_;
+}
+
+size_t TermFilter::GetTermCount() const
+{
+    return term_count_;
+}
+
+size_t TermFilter::GetMemoryUsage() const
+{
+    return blocks_.capacity() * sizeof(Block);
+}
+
+TermFilter::Block TermFilter::MakeMask(uint64_t hash)
+{
+    Block mask;
+    const uint32_t key = static_cast<uint32_t>(hash);
+    for (size_t i = 0; i < mask.lanes.size(); ++i)
+    {
+        mask.lanes[i] = 1u << ((key * LANE_SALTS[i]) >> 27);
+    }
+    return mask;
+}
+
+size_t TermFilter::GetBlockIndex(uint64_t hash) const
+{
+    // The high half of the hash picks the block, the low half the bits in it
+    return static_cast<size_t>(((hash >> 32) * blocks_.size()) >> 32);
+}
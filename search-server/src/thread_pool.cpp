@@ -0,0 +1,307 @@
+#include "thread_pool.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+
+// Worker index of the current thread in the pool it belongs to
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+// A waiting thread with nothing to run rechecks the queues this often for tasks of nested calls
+const auto WAIT_POLL_INTERVAL = chrono::microseconds(200);
+
+#ifdef __linux__
+vector<int> GetAllowedCpus()
+{
+    vector<int> cpus;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &cpu_set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+// Parses a sysfs CPU list such as 0-3,8-11
+vector<int> ParseCpuList(const string& text)
+{
+    vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        const size_t comma_pos = min(text.find(',', pos), text.size());
+        const string range = text.substr(pos, comma_pos - pos);
+        const size_t dash_pos = range.find('-');
+        try
+        {
+            const int first = stoi(range.substr(0, dash_pos));
+            const int last = dash_pos == range.npos ? first : stoi(range.substr(dash_pos + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const logic_error&)
+        {
+        }
+        pos = comma_pos + 1;
+    }
+    return cpus;
+}
+
+// Allowed CPUs of every NUMA node; a single node holding all allowed CPUs if sysfs tells nothing
+vector<vector<int>> GetNumaNodeCpus(const vector<int>& allowed_cpus)
+{
+    vector<vector<int>> nodes;
+    for (int node = 0;; ++node)
+    {
+        ifstream cpu_list("/sys/devices/system/node/node"s + to_string(node) + "/cpulist"s);
+        string text;
+        if (!cpu_list || !getline(cpu_list, text))
+        {
+            break;
+        }
+        vector<int> node_cpus;
+        for (const int cpu : ParseCpuList(text))
+        {
+            if (find(allowed_cpus.begin(), allowed_cpus.end(), cpu) != allowed_cpus.end())
+            {
+                node_cpus.push_back(cpu);
+            }
+        }
+        if (!node_cpus.empty())
+        {
+            nodes.push_back(move(node_cpus));
+        }
+    }
+    if (nodes.empty())
+    {
+        nodes.push_back(allowed_cpus);
+    }
+    return nodes;
+}
+
+// Placement is an optimization only, a worker runs unrestricted if its CPUs are not available
+void PlaceWorker(thread& worker, size_t index, const ThreadPoolOptions& options, const vector<int>& allowed_cpus,
+    const vector<vector<int>>& nodes)
+{
+    if (allowed_cpus.empty() || !(options.pin_threads || options.numa_aware))
+    {
+        return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (options.numa_aware)
+    {
+        const vector<int>& node_cpus = nodes[index % nodes.size()];
+        if (options.pin_threads)
+        {
+            CPU_SET(node_cpus[index / nodes.size() % node_cpus.size()], &cpu_set);
+        }
+        else
+        {
+            for (const int cpu : node_cpus)
+            {
+                CPU_SET(cpu, &cpu_set);
+            }
+        }
+    }
+    else
+    {
+        CPU_SET(allowed_cpus[index % allowed_cpus.size()], &cpu_set);
+    }
+    pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set), &cpu_set);
+}
+#endif
+
+}
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& options)
+{
+#ifdef __linux__
+    const vector<int> allowed_cpus = GetAllowedCpus();
+    const vector<vector<int>> nodes = options.numa_aware ? GetNumaNodeCpus(allowed_cpus) : vector<vector<int>>{};
+    size_t thread_count = options.thread_count != 0 ? options.thread_count : allowed_cpus.size();
+#else
+    size_t thread_count = options.thread_count != 0 ? options.thread_count : thread::hardware_concurrency();
+#endif
+    // The calling thread is one of the threads of a parallel call
+    const size_t worker_count = max<size_t>(thread_count, 1) - 1;
+    queues_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        workers_.emplace_back([this, i]
+            {
+                WorkerLoop(i);
+            });
+#ifdef __linux__
+        PlaceWorker(workers_.back(), i, options, allowed_cpus, nodes);
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard lg(sleep_mut_);
+        is_stopped_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (thread& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const
+{
+    return workers_.size() + 1;
+}
+
+ThreadPoolStatistics ThreadPool::GetStatistics() const
+{
+    ThreadPoolStatistics statistics;
+    statistics.thread_count = GetThreadCount();
+    statistics.task_count = task_count_;
+    statistics.stolen_task_count = stolen_task_count_;
+    statistics.queued_task_count = queued_task_count_;
+    statistics.max_queue_depth = max_queue_depth_;
+    return statistics;
+}
+
+void ThreadPool::Push(function<void()> task)
+{
+    // Workers push nested tasks to their own queue, other threads spread tasks over all queues
+    const size_t index = current_pool == this ? current_worker_index : next_queue_++ % queues_.size();
+    // Counted before the task is visible, so the count never drops below zero
+    ++queued_task_count_;
+    size_t queue_depth;
+    {
+        WorkerQueue& queue = *queues_[index];
+        lock_guard lg(queue.mut);
+        queue.tasks.push_back(move(task));
+        queue_depth = queue.tasks.size();
+    }
+    for (size_t max_depth = max_queue_depth_; max_depth < queue_depth
+        && !max_queue_depth_.compare_exchange_weak(max_depth, queue_depth);)
+    {
+    }
+    {
+        lock_guard lg(sleep_mut_);
+    }
+    sleep_cv_.notify_one();
+}
+
+bool ThreadPool::TryRunTask()
+{
+    if (queued_task_count_ == 0)
+    {
+        return false;
+    }
+    const bool is_worker = current_pool == this;
+    const size_t home_index = is_worker ? current_worker_index : next_queue_ % queues_.size();
+    function<void()> task;
+    bool is_stolen = false;
+    for (size_t offset = 0; offset < queues_.size() && !task; ++offset)
+    {
+        WorkerQueue& queue = *queues_[(home_index + offset) % queues_.size()];
+        lock_guard lg(queue.mut);
+        if (queue.tasks.empty())
+        {
+            continue;
+        }
+        is_stolen = !is_worker || offset != 0;
+        if (is_stolen)
+        {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+    if (!task)
+    {
+        return false;
+    }
+    --queued_task_count_;
+    ++task_count_;
+    if (is_stolen)
+    {
+        ++stolen_task_count_;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::Wait(Job& job)
+{
+    while (true)
+    {
+        {
+            lock_guard lg(job.mut);
+            if (job.remaining_chunk_count == 0)
+            {
+                return;
+            }
+        }
+        if (!TryRunTask())
+        {
+            unique_lock lock(job.mut);
+            if (job.cv.wait_for(lock, WAIT_POLL_INTERVAL, [&job]
+                {
+                    return job.remaining_chunk_count == 0;
+                }))
+            {
+                return;
+            }
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+    current_pool = this;
+    current_worker_index = index;
+    while (true)
+    {
+        if (TryRunTask())
+        {
+            continue;
+        }
+        unique_lock lock(sleep_mut_);
+        sleep_cv_.wait(lock, [this]
+            {
+                return is_stopped_ || queued_task_count_ > 0;
+            });
+        if (is_stopped_ && queued_task_count_ == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,378 @@
+#include "write_ahead_log.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <execution>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+
+struct LogRecordHeader
+{
+    uint32_t payload_size;
+    uint32_t checksum;
+};
+
+// Operation and document id
+const size_t MIN_PAYLOAD_SIZE = sizeof(LogOperation) + sizeof(int);
+const size_t MAX_PAYLOAD_SIZE = 256u << 20;
+// Appending blocks while this much is waiting for the flusher, so a slow disk throttles writers
+const size_t MAX_BUFFERED_BYTES = 64u << 20;
+
+uint32_t ComputeCrc32(string_view data)
+{
+    static const auto table = []
+    {
+        array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < result.size(); ++i)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+            }
+            result[i] = crc;
+        }
+        return result;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data)
+    {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+class RecordWriter
+{
+public:
+    RecordWriter()
+    {
+        record_.resize(sizeof(LogRecordHeader));
+    }
+
+    template <typename T>
+    void Put(T value)
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        record_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void PutString(string_view str)
+    {
+        Put(static_cast<uint32_t>(str.size()));
+        record_.append(str);
+    }
+
+    string Finish()
+    {
+        const string_view payload = string_view(record_).substr(sizeof(LogRecordHeader));
+        if (payload.size() > MAX_PAYLOAD_SIZE)
+        {
+            throw invalid_argument("Log record is too large"s);
+        }
+        const LogRecordHeader header{ static_cast<uint32_t>(payload.size()), ComputeCrc32(payload) };
+        memcpy(record_.data(), &header, sizeof(header));
+        return move(record_);
+    }
+
+private:
+    string record_;
+};
+
+class RecordReader
+{
+public:
+    explicit RecordReader(string_view payload)
+        : payload_(payload)
+    {
+
+    }
+
+    template <typename T>
+    bool Get(T& value)
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        if (payload_.size() < sizeof(T))
+        {
+            return false;
+        }
+        memcpy(&value, payload_.data(), sizeof(value));
+        payload_.remove_prefix(sizeof(value));
+        return true;
+    }
+
+    bool GetString(string_view& str)
+    {
+        uint32_t size;
+        if (!Get(size) || payload_.size() < size)
+        {
+            return false;
+        }
+        str = payload_.substr(0, size);
+        payload_.remove_prefix(size);
+        return true;
+    }
+
+    bool IsEmpty() const
+    {
+        return payload_.empty();
+    }
+
+private:
+    string_view payload_;
+};
+
+// The checksum has been verified, so a malformed payload means a record of an unknown format
+bool DecodeRecord(string_view payload, LogRecord& record)
+{
+    RecordReader reader(payload);
+    if (!reader.Get(record.operation) || !reader.Get(record.document_id))
+    {
+        return false;
+    }
+    if (record.operation == LogOperation::REMOVE_DOCUMENT)
+    {
+        return reader.IsEmpty();
+    }
+    if (record.operation != LogOperation::ADD_DOCUMENT)
+    {
+        return false;
+    }
+    uint32_t rating_count;
+    if (!reader.Get(record.status) || !reader.Get(rating_count) || rating_count > payload.size() / sizeof(int))
+    {
+        return false;
+    }
+    record.ratings.resize(rating_count);
+    for (int& rating : record.ratings)
+    {
+        if (!reader.Get(rating))
+        {
+            return false;
+        }
+    }
+    return reader.GetString(record.text) && reader.IsEmpty();
+}
+
+}
+
+WriteAheadLog::WriteAheadLog(const string& path)
+{
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        throw system_error(errno, generic_category(), "Can not open "s + path);
+    }
+    flusher_ = thread([this]
+        {
+            FlushLoop();
+        });
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        lock_guard lg(mut_);
+        is_stopped_ = true;
+    }
+    data_ready_.notify_one();
+    flusher_.join();
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings)
+{
+    RecordWriter writer;
+    writer.Put(LogOperation::ADD_DOCUMENT);
+    writer.Put(document_id);
+    writer.Put(status);
+    writer.Put(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings)
+    {
+        writer.Put(rating);
+    }
+    writer.PutString(document);
+    return Append(writer.Finish());
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id)
+{
+    RecordWriter writer;
+    writer.Put(LogOperation::REMOVE_DOCUMENT);
+    writer.Put(document_id);
+    return Append(writer.Finish());
+}
+
+uint64_t WriteAheadLog::Append(const string& record)
+{
+    uint64_t sequence_number;
+    {
+        unique_lock lock(mut_);
+        data_written_.wait(lock, [this]
+            {
+                return error_ != 0 || buffer_.size() < MAX_BUFFERED_BYTES;
+            });
+        if (error_ != 0)
+        {
+            throw system_error(error_, generic_category(), "Write-ahead log is not writable"s);
+        }
+        buffer_.append(record);
+        sequence_number = ++appended_sequence_number_;
+        ++statistics_.record_count;
+        statistics_.byte_count += record.size();
+    }
+    data_ready_.notify_one();
+    return sequence_number;
+}
+
+void WriteAheadLog::WaitDurable(uint64_t sequence_number)
+{
+    unique_lock lock(mut_);
+    data_written_.wait(lock, [this, sequence_number]
+        {
+            return error_ != 0 || durable_sequence_number_ >= sequence_number;
+        });
+    if (durable_sequence_number_ < sequence_number)
+    {
+        throw system_error(error_, generic_category(), "Write-ahead log is not writable"s);
+    }
+}
+
+void WriteAheadLog::Sync()
+{
+    uint64_t sequence_number;
+    {
+        lock_guard lg(mut_);
+        sequence_number = appended_sequence_number_;
+    }
+    WaitDurable(sequence_number);
+}
+
+WriteAheadLogStatistics WriteAheadLog::GetStatistics() const
+{
+    lock_guard lg(mut_);
+    return statistics_;
+}
+
+void WriteAheadLog::FlushLoop()
+{
+    // Records appended while a batch is being synced make up the next batch
+    string batch;
+    unique_lock lock(mut_);
+    while (true)
+    {
+        data_ready_.wait(lock, [this]
+            {
+                return is_stopped_ || !buffer_.empty();
+            });
+        if (buffer_.empty())
+        {
+            return;
+        }
+        batch.clear();
+        batch.swap(buffer_);
+        const uint64_t batch_sequence_number = appended_sequence_number_;
+        lock.unlock();
+        data_written_.notify_all();
+
+        int error = 0;
+        for (size_t written = 0; written < batch.size();)
+        {
+            const ssize_t size = write(fd_, batch.data() + written, batch.size() - written);
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            written += static_cast<size_t>(size);
+        }
+        if (error == 0 && fdatasync(fd_) < 0)
+        {
+            error = errno;
+        }
+
+        lock.lock();
+        if (error != 0)
+        {
+            error_ = error;
+            data_written_.notify_all();
+            return;
+        }
+        durable_sequence_number_ = batch_sequence_number;
+        ++statistics_.sync_count;
+        data_written_.notify_all();
+    }
+}
+
+LogReader::LogReader(const string& path)
+{
+    if (access(path.c_str(), F_OK) < 0 && errno == ENOENT)
+    {
+        return;
+    }
+    file_.emplace(path);
+    const string_view data(file_->GetData(), file_->GetSize());
+
+    // Record boundaries are found by hopping over the headers; checksums are verified and payloads
+    // decoded in parallel afterwards
+    vector<string_view> payloads;
+    size_t offset = 0;
+    while (data.size() - offset >= sizeof(LogRecordHeader))
+    {
+        LogRecordHeader header;
+        memcpy(&header, data.data() + offset, sizeof(header));
+        if (header.payload_size < MIN_PAYLOAD_SIZE || header.payload_size > MAX_PAYLOAD_SIZE
+            || header.payload_size > data.size() - offset - sizeof(header))
+        {
+            break;
+        }
+        payloads.push_back(data.substr(offset + sizeof(header), header.payload_size));
+        offset += sizeof(header) + header.payload_size;
+    }
+
+    records_.resize(payloads.size());
+    vector<char> is_valid(payloads.size());
+    for_each(execution::par, payloads.begin(), payloads.end(), [this, &payloads, &is_valid](const string_view& payload)
+        {
+            const size_t index = &payload - payloads.data();
+            LogRecordHeader header;
+            memcpy(&header, payload.data() - sizeof(header), sizeof(header));
+            is_valid[index] = header.checksum == ComputeCrc32(payload) && DecodeRecord(payload, records_[index]);
+        });
+
+    const size_t valid_count = find(is_valid.begin(), is_valid.end(), false) - is_valid.begin();
+    records_.resize(valid_count);
+    valid_size_ = valid_count == payloads.size()
+        ? offset
+        : static_cast<size_t>(payloads[valid_count].data() - data.data()) - sizeof(LogRecordHeader);
+}
+
+const vector<LogRecord>& LogReader::GetRecords() const
+{
+    return records_;
+}
+
+size_t LogReader::GetValidSize() const
+{
+    return valid_size_;
+}
+
+size_t LogReader::GetSize() const
+{
+    return file_ ? file_->GetSize() : 0;
+}
@@ -0,0 +1,1368 @@
+#include "search_server.h"
+#include "document_loader.h"
+#include "durable_search_server.h"
+#include "result_cursor.h"
+#include "request_queue.h"
+#include "shard_rpc.h"
+#include "sharded_search_server.h"
+#include "generators.h"
+
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+template <typename T, typename U>
+void AssertEqualImpl(const T& t, const U& u, const string& t_str, const string& u_str, const string& file,
+    const string& func, unsigned line, const string& hint)
+{
+    if (t != u)
+    {
+        cerr << boolalpha;
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
+        cerr << t << " != "s << u << "."s;
+        if (!hint.empty())
+        {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+    const string& hint)
+{
+    if (!value)
+    {
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty())
+        {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+template <typename Exception, typename Function>
+void AssertThrowsImpl(Function function, const string& expr_str, const string& file, const string& func, unsigned line)
+{
+    try
+    {
+        function();
+    }
+    catch (const Exception&)
+    {
+        return;
+    }
+    AssertImpl(false, expr_str + " throws"s, file, func, line, ""s);
+}
+
+#define ASSERT_THROWS(expr, exception) AssertThrowsImpl<exception>([&] { expr; }, #expr, __FILE__, __FUNCTION__, __LINE__)
+
+template <typename Function>
+void RunTestImpl(Function function, const string& function_name)
+{
+    function();
+    cerr << function_name << " OK"s << endl;
+}
+
+#define RUN_TEST(func) RunTestImpl(func, #func)
+
+void AssertSameDocuments(const vector<Document>& expected, const vector<Document>& actual)
+{
+    ASSERT_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        ASSERT(abs(expected[i].relevance - actual[i].relevance) < EPSILON);
+        ASSERT_EQUAL(expected[i].rating, actual[i].rating);
+    }
+}
+
+vector<string> MakeCorpus(int document_count)
+{
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 5);
+    return GenerateQueries(generator, dictionary, ZipfDistribution(dictionary.size(), 1.0), document_count, 20);
+}
+
+void TestExcludeStopWordsFromAddedDocumentContent()
+{
+    SearchServer server("in the"s);
+    server.AddDocument(42, "cat in the city"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+    ASSERT(server.FindTopDocuments("in"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+}
+
+void TestMinusWordsExcludeDocuments()
+{
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    const auto documents = server.FindTopDocuments("cat -black"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+}
+
+void TestRelevanceIsTfIdf()
+{
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat white tail"s, DocumentStatus::ACTUAL, { 5 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 3 });
+    const auto documents = server.FindTopDocuments("white"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT(abs(documents[0].relevance - 0.5 * log(2.0)) < EPSILON);
+    ASSERT_EQUAL(documents[0].rating, 5);
+}
+
+void TestBm25Scorer()
+{
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat white tail"s, DocumentStatus::ACTUAL, { 5 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::BANNED, { 3 });
+    const CorpusStatistics statistics = server.GetCorpusStatistics();
+    ASSERT_EQUAL(statistics.document_count, 2);
+    ASSERT(abs(statistics.average_document_length - 3.0) < EPSILON);
+
+    // count * (K1 + 1) / (count + K1 * (1 - B + B * length / average_length)) * idf
+    const double expected = 2 * 2.2 / (2 + 1.2 * (0.25 + 0.75 * 4 / 3.0)) * log(2.0);
+    auto documents = server.FindTopDocuments<Bm25Scorer>("white"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT(abs(documents[0].relevance - expected) < EPSILON);
+    documents = server.FindTopDocuments<Bm25Scorer>(execution::par, "white"s);
+    ASSERT(abs(documents[0].relevance - expected) < EPSILON);
+    ASSERT(documents[0].relevance <= Bm25Scorer(statistics).GetUpperBound(Bm25Scorer(statistics).GetTermWeight(log(2.0))));
+    ASSERT_EQUAL(server.FindTopDocuments<Bm25Scorer>("dog"s, DocumentStatus::BANNED).size(), 1u);
+
+    server.RemoveDocument(1);
+    ASSERT(abs(server.GetCorpusStatistics().average_document_length - 2.0) < EPSILON);
+}
+
+void TestStatusAndPredicateFilters()
+{
+    SearchServer server(""s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat"s, DocumentStatus::BANNED, { 2 });
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "cat"s, [](int document_id, DocumentStatus, int)
+        {
+            return document_id == 2;
+        })[0].id, 2);
+}
+
+void TestPredicateFastPaths()
+{
+    const auto documents = MakeCorpus(300);
+    SearchServer server(""s);
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], i % 3 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED,
+            { static_cast<int>(i % 5) });
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(DocumentStatus::BANNED), 100);
+    ASSERT_EQUAL(server.GetDocumentCount(DocumentStatus::REMOVED), 0);
+
+    auto lambda_status = [](DocumentStatus status)
+    {
+        return [status](int, DocumentStatus document_status, int)
+        {
+            return document_status == status;
+        };
+    };
+    for (int i = 0; i < 20; ++i)
+    {
+        const string query = documents[i] + " -"s + documents[i + 1].substr(0, documents[i + 1].find(' '));
+        const auto expected = server.FindTopDocuments(query, lambda_status(DocumentStatus::ACTUAL));
+        AssertSameDocuments(expected, server.FindTopDocuments(query));
+        AssertSameDocuments(expected, server.FindTopDocuments(execution::par, query));
+        AssertSameDocuments(server.FindTopDocuments(query, lambda_status(DocumentStatus::BANNED)),
+            server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED));
+        AssertSameDocuments(server.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; }),
+            server.FindTopDocuments(query, AcceptAllPredicate()));
+        ASSERT(server.FindTopDocuments(query, DocumentStatus::REMOVED).empty());
+    }
+
+    server.RemoveDocument(0);
+    ASSERT_EQUAL(server.GetDocumentCount(DocumentStatus::BANNED), 99);
+}
+
+void TestParallelQueryRanges()
+{
+    const auto documents = MakeCorpus(1000);
+    SearchServer server(""s);
+    // Sparse ids leave some ranges empty
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i * i), documents[i], i % 4 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED,
+            { static_cast<int>(i % 5) });
+    }
+    const int max_result_document_count = MAX_RESULT_DOCUMENT_COUNT;
+    const int min_query_range_document_count = MIN_QUERY_RANGE_DOCUMENT_COUNT;
+    MAX_RESULT_DOCUMENT_COUNT = 2000;
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = 8;
+    for (int i = 0; i < 20; ++i)
+    {
+        const string word = documents[i].substr(0, documents[i].find(' '));
+        for (const string& query : { word, word + " "s + documents[i + 1], documents[i] + " -"s + word })
+        {
+            const auto expected = server.FindTopDocuments(execution::seq, query);
+            const auto actual = server.FindTopDocuments(execution::par, query);
+            AssertSameDocuments(expected, actual);
+            ASSERT(!expected.empty() || query.find('-') != string::npos);
+            // Documents tied on relevance and rating may come in any order
+            set<int> expected_ids;
+            set<int> actual_ids;
+            for (size_t j = 0; j < expected.size(); ++j)
+            {
+                expected_ids.insert(expected[j].id);
+                actual_ids.insert(actual[j].id);
+            }
+            ASSERT(expected_ids == actual_ids);
+            AssertSameDocuments(server.FindTopDocuments(execution::seq, query, DocumentStatus::BANNED),
+                server.FindTopDocuments(execution::par, query, DocumentStatus::BANNED));
+            AssertSameDocuments(expected, server.FindTopDocuments(thread_pool_policy, query));
+        }
+    }
+    MAX_RESULT_DOCUMENT_COUNT = max_result_document_count;
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = min_query_range_document_count;
+}
+
+void TestParallelQueryRangesSkewedIds()
+{
+    const auto documents = MakeCorpus(1000);
+    SearchServer server(""s);
+    // One outlier near the top of the id space, the rest packed at the bottom
+    for (size_t i = 0; i + 1 < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 5) });
+    }
+    server.AddDocument(numeric_limits<int>::max() - 1, documents.back(), DocumentStatus::ACTUAL, { 1 });
+    const int max_result_document_count = MAX_RESULT_DOCUMENT_COUNT;
+    const int min_query_range_document_count = MIN_QUERY_RANGE_DOCUMENT_COUNT;
+    MAX_RESULT_DOCUMENT_COUNT = 2000;
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = 8;
+    auto assert_same_results = [&]
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            const string word = documents[i].substr(0, documents[i].find(' '));
+            for (const string& query : { word, documents[i] + " -"s + word, documents.back() })
+            {
+                const auto expected = server.FindTopDocuments(execution::seq, query);
+                AssertSameDocuments(expected, server.FindTopDocuments(execution::par, query));
+                AssertSameDocuments(expected, server.FindTopDocuments(thread_pool_policy, query));
+            }
+        }
+    };
+    assert_same_results();
+    // The quantiles taken by the queries above go stale
+    for (int i = 0; i < 100; ++i)
+    {
+        server.RemoveDocument(i);
+        server.AddDocument(numeric_limits<int>::max() - 2 - i, documents[i], DocumentStatus::ACTUAL, { 2 });
+    }
+    assert_same_results();
+    for (int i = 100; i < 900; ++i)
+    {
+        server.RemoveDocument(i);
+    }
+    assert_same_results();
+    MAX_RESULT_DOCUMENT_COUNT = max_result_document_count;
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = min_query_range_document_count;
+}
+
+void TestFacets()
+{
+    const auto documents = MakeCorpus(400);
+    SearchServer server(""s);
+    const DocumentStatus statuses[] = { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED };
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], statuses[i % 3], { static_cast<int>(i % 5) });
+    }
+    const int max_result_document_count = MAX_RESULT_DOCUMENT_COUNT;
+    const int min_query_range_document_count = MIN_QUERY_RANGE_DOCUMENT_COUNT;
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = 8;
+    auto is_rated_high = [](int, DocumentStatus status, int rating)
+    {
+        return status == DocumentStatus::ACTUAL && rating > 2;
+    };
+    for (int i = 0; i < 20; ++i)
+    {
+        const string query = documents[i] + " -"s + documents[i + 1].substr(0, documents[i + 1].find(' '));
+        MAX_RESULT_DOCUMENT_COUNT = 1000;
+        FacetCounts expected;
+        for (const DocumentStatus status : statuses)
+        {
+            const int count = static_cast<int>(server.FindTopDocuments(query, status).size());
+            if (count > 0)
+            {
+                expected.status_counts[status] = count;
+            }
+        }
+        for (const Document& document : server.FindTopDocuments(query, is_rated_high))
+        {
+            ++expected.rating_counts[document.rating];
+        }
+        const auto expected_documents = server.FindTopDocuments(query, is_rated_high);
+        MAX_RESULT_DOCUMENT_COUNT = max_result_document_count;
+
+        for (const auto& result : { server.FindTopDocumentsWithFacets(execution::seq, query, is_rated_high),
+            server.FindTopDocumentsWithFacets(execution::par, query, is_rated_high),
+            server.FindTopDocumentsWithFacets(thread_pool_policy, query, is_rated_high) })
+        {
+            ASSERT(result.facets.status_counts == expected.status_counts);
+            ASSERT(result.facets.rating_counts == expected.rating_counts);
+            ASSERT_EQUAL(result.documents.size(), min(expected_documents.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)));
+            AssertSameDocuments(server.FindTopDocuments(query, is_rated_high), result.documents);
+        }
+        const auto banned = server.FindTopDocumentsWithFacets(execution::par, query, DocumentStatus::BANNED);
+        ASSERT(banned.facets.status_counts == expected.status_counts);
+        AssertSameDocuments(server.FindTopDocuments(query, DocumentStatus::BANNED), banned.documents);
+        ASSERT(server.FindTopDocumentsWithFacets(query, DocumentStatus::REMOVED).facets.status_counts == expected.status_counts);
+    }
+    MIN_QUERY_RANGE_DOCUMENT_COUNT = min_query_range_document_count;
+
+    // Documents not matching the phrase are not counted
+    SearchServer phrase_server(""s);
+    phrase_server.EnablePositionalIndex();
+    phrase_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    phrase_server.AddDocument(2, "cat white"s, DocumentStatus::BANNED, { 2 });
+    phrase_server.AddDocument(3, "white cat"s, DocumentStatus::BANNED, { 3 });
+    const auto result = phrase_server.FindTopDocumentsWithFacets("\"white cat\""s);
+    ASSERT_EQUAL(result.documents.size(), 1u);
+    ASSERT_EQUAL(result.facets.status_counts.at(DocumentStatus::ACTUAL), 1);
+    ASSERT_EQUAL(result.facets.status_counts.at(DocumentStatus::BANNED), 1);
+    ASSERT_EQUAL(result.facets.rating_counts.size(), 1u);
+}
+
+void TestResultCursor()
+{
+    const auto documents = MakeCorpus(300);
+    SearchServer server(""s);
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 7) });
+    }
+    const string query = documents[0] + " "s + documents[1];
+    const int max_result_document_count = MAX_RESULT_DOCUMENT_COUNT;
+    MAX_RESULT_DOCUMENT_COUNT = 1000;
+    const auto expected = server.FindTopDocuments(query);
+    MAX_RESULT_DOCUMENT_COUNT = max_result_document_count;
+    ASSERT(expected.size() > 50u);
+    AssertSameDocuments(expected, server.FindRankedDocuments(execution::par, query, DocumentStatus::ACTUAL));
+
+    ResultCursorCache cache(server);
+    vector<Document> paged;
+    ResultPage page = cache.FindFirstPage(execution::seq, query, 7);
+    ASSERT_EQUAL(page.document_count, expected.size());
+    for (paged = page.documents; page.next_cursor; paged.insert(paged.end(), page.documents.begin(), page.documents.end()))
+    {
+        ASSERT_EQUAL(page.documents.size(), 7u);
+        page = cache.GetPage(*page.next_cursor);
+    }
+    AssertSameDocuments(expected, paged);
+
+    // Any page can be asked for directly
+    const uint64_t snapshot_id = cache.FindFirstPage(thread_pool_policy, query, DocumentStatus::ACTUAL, 10).next_cursor->snapshot_id;
+    const auto fifth_page = cache.GetPage({ snapshot_id, 40, 10 }).documents;
+    AssertSameDocuments({ expected.begin() + 40, expected.begin() + 50 }, fifth_page);
+    ASSERT(cache.GetPage({ snapshot_id, expected.size(), 10 }).documents.empty());
+    ASSERT_EQUAL(cache.GetStatistics().snapshot_count, 2u);
+
+    cache.Close(snapshot_id);
+    ASSERT_THROWS(cache.GetPage({ snapshot_id, 0, 10 }), out_of_range);
+
+    ResultCursorCache expiring_cache(server, { chrono::milliseconds(0) });
+    ASSERT_THROWS(expiring_cache.GetPage(*expiring_cache.FindFirstPage(execution::seq, query, 10).next_cursor), out_of_range);
+
+    // Every snapshot takes most of the budget, so a new one evicts the previous
+    ResultCursorCache small_cache(server, { chrono::minutes(1), expected.size() * sizeof(Document) });
+    const ResultCursor first_cursor = *small_cache.FindFirstPage(execution::seq, query, 10).next_cursor;
+    const ResultCursor second_cursor = *small_cache.FindFirstPage(execution::seq, query, 10).next_cursor;
+    ASSERT_THROWS(small_cache.GetPage(first_cursor), out_of_range);
+    ASSERT_EQUAL(small_cache.GetPage(second_cursor).documents.size(), 10u);
+    const ResultCursorStatistics statistics = small_cache.GetStatistics();
+    ASSERT_EQUAL(statistics.snapshot_count, 1u);
+    ASSERT_EQUAL(statistics.evicted_snapshot_count, 1u);
+    ASSERT(statistics.byte_count <= expected.size() * sizeof(Document));
+
+    // A result over the whole budget keeps its best documents
+    ResultCursorCache tiny_cache(server, { chrono::minutes(1), 1024 });
+    const ResultPage tiny_page = tiny_cache.FindFirstPage(execution::seq, query, 10);
+    ASSERT(tiny_page.document_count > 0u && tiny_page.document_count < expected.size());
+    AssertSameDocuments({ expected.begin(), expected.begin() + 10 }, tiny_page.documents);
+
+    // Snapshots taken before the index changed are not served
+    const ResultCursor cursor = *cache.FindFirstPage(execution::seq, query, 10).next_cursor;
+    server.RemoveDocument(0);
+    ASSERT_THROWS(cache.GetPage(cursor), out_of_range);
+    ASSERT_EQUAL(cache.GetStatistics().expired_snapshot_count, 1u);
+}
+
+void TestRequestStatistics()
+{
+    using Clock = RequestStatistics::Clock;
+    const Clock::time_point base(chrono::hours(1000));
+    auto statistics = make_unique<RequestStatistics>();
+    // One request every 10 seconds for two days, every third of them empty
+    for (int i = 0; i < 2 * 24 * 360; ++i)
+    {
+        statistics->Record(base + chrono::seconds(10 * i), i % 3 == 0, chrono::microseconds(100));
+    }
+    const Clock::time_point end = base + chrono::seconds(10 * (2 * 24 * 360 - 1));
+    RequestWindowStatistics window = statistics->GetStatistics(chrono::seconds(60), end);
+    ASSERT_EQUAL(window.request_count, 6u);
+    ASSERT_EQUAL(window.no_result_count, 2u);
+    ASSERT(window.GetAverageLatency() == chrono::microseconds(100));
+    ASSERT_EQUAL(statistics->GetStatistics(chrono::seconds(300), end).request_count, 30u);
+    ASSERT_EQUAL(statistics->GetStatistics(chrono::minutes(90), end).request_count, 540u);
+    window = statistics->GetStatistics(chrono::hours(24), end);
+    ASSERT_EQUAL(window.request_count, 8640u);
+    ASSERT_EQUAL(window.no_result_count, 2880u);
+    ASSERT(window.latency_sum == chrono::microseconds(864000));
+    ASSERT_EQUAL(statistics->GetStatistics(chrono::hours(1), end + chrono::hours(2)).request_count, 0u);
+    ASSERT_THROWS(statistics->GetStatistics(chrono::hours(25), end), invalid_argument);
+
+    // Threads share slots with no lock
+    statistics = make_unique<RequestStatistics>();
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&statistics, &base, t]
+            {
+                for (int i = 0; i < 20000; ++i)
+                {
+                    statistics->Record(base + chrono::milliseconds(i / 4), (i + t) % 2 == 0, chrono::nanoseconds(1));
+                }
+            });
+    }
+    for (thread& worker : threads)
+    {
+        worker.join();
+    }
+    window = statistics->GetStatistics(chrono::seconds(10), base + chrono::seconds(5));
+    ASSERT_EQUAL(window.request_count, 80000u);
+    ASSERT_EQUAL(window.no_result_count, 40000u);
+    ASSERT_EQUAL(statistics->GetStatistics(chrono::minutes(10), base + chrono::seconds(5)).request_count, 80000u);
+
+    SearchServer server(""s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::BANNED, { 2 });
+    RequestQueue request_queue(server);
+    ASSERT_EQUAL(request_queue.AddFindRequest(execution::seq, "cat"s).size(), 1u);
+    ASSERT(request_queue.AddFindRequest(execution::par, "dog"s).empty());
+    ASSERT_EQUAL(request_queue.AddFindRequest(thread_pool_policy, "dog"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT(request_queue.AddFindRequest(execution::seq, "cat"s, [](int, DocumentStatus, int rating)
+        {
+            return rating > 1;
+        }).empty());
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 2);
+    ASSERT_EQUAL(request_queue.GetStatistics(chrono::minutes(1)).request_count, 4u);
+}
+
+void TestThreadPool()
+{
+    ThreadPool pool({ 3 });
+    ASSERT_EQUAL(pool.GetThreadCount(), 3u);
+    atomic<int> sum = 0;
+    // Nested calls run while their callers wait
+    pool.ParallelFor(10, [&](size_t i)
+        {
+            pool.ParallelFor(100, [&](size_t j)
+                {
+                    sum += static_cast<int>(i * 100 + j);
+                });
+        });
+    ASSERT_EQUAL(sum.load(), 999 * 1000 / 2);
+    ASSERT_THROWS(pool.ParallelFor(50, [](size_t i)
+        {
+            if (i == 42)
+            {
+                throw out_of_range("42"s);
+            }
+        }), out_of_range);
+    ASSERT_EQUAL(pool.Submit([] { return 7; }).get(), 7);
+    const ThreadPoolStatistics statistics = pool.GetStatistics();
+    ASSERT(statistics.task_count > 0);
+    ASSERT(statistics.max_queue_depth > 0);
+    ASSERT_EQUAL(statistics.queued_task_count, 0u);
+
+    const auto documents = MakeCorpus(300);
+    SearchServer server(""s);
+    server.SetThreadPoolOptions({ 2, true, true });
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 5) });
+    }
+    const vector<string> queries(documents.begin(), documents.begin() + 40);
+    const auto expected = ProcessQueries(server, queries);
+    const auto actual = ProcessQueries(thread_pool_policy, server, queries);
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        AssertSameDocuments(expected[i], actual[i]);
+        const string query = queries[i] + " -"s + documents[i + 1].substr(0, documents[i + 1].find(' '));
+        for (const int document_id : { 0, static_cast<int>(i) })
+        {
+            const auto [par_words, par_status] = server.MatchDocument(execution::par, query, document_id);
+            const auto [pool_words, pool_status] = server.MatchDocument(thread_pool_policy, query, document_id);
+            ASSERT(par_words == pool_words);
+            ASSERT(par_status == pool_status);
+        }
+    }
+    ASSERT_EQUAL(server.GetThreadPool().GetThreadCount(), 2u);
+}
+
+void TestMatchAndRemoveDocument()
+{
+    SearchServer server(""s);
+    server.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, { 1 });
+    const auto [words, status] = server.MatchDocument("cat fluffy -dog"s, 1);
+    ASSERT_EQUAL(words.size(), 2u);
+    const auto [minus_words, minus_status] = server.MatchDocument(execution::par, "cat -fluffy"s, 1);
+    ASSERT(minus_words.empty());
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(server.GetDocumentCount(), 0);
+    ASSERT(server.FindTopDocuments("cat"s).empty());
+}
+
+void TestInvalidInputThrows()
+{
+    SearchServer server(""s);
+    ASSERT_THROWS(server.AddDocument(-1, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+    ASSERT_THROWS(server.FindTopDocuments("--cat"s), invalid_argument);
+}
+
+void TestPhraseQueries()
+{
+    SearchServer server("the"s);
+    server.EnablePositionalIndex();
+    server.AddDocument(1, "quick brown fox"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "brown quick fox"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "quick the fox"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(4, "quick red brown fox"s, DocumentStatus::ACTUAL, { 1 });
+
+    auto documents = server.FindTopDocuments("\"quick brown\""s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+
+    // A stop word keeps its place in the phrase
+    documents = server.FindTopDocuments("\"quick fox\""s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 2);
+    ASSERT_EQUAL(server.FindTopDocuments("\"quick the fox\""s).size(), 2u);
+
+    // Closer matches rank higher
+    documents = server.FindTopDocuments("\"quick brown\"~1"s);
+    ASSERT_EQUAL(documents.size(), 2u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    ASSERT_EQUAL(documents[1].id, 4);
+
+    // MatchDocument agrees with FindTopDocuments on phrases
+    const string phrase_query = "\"quick brown\""s;
+    for (int document_id : { 1, 4 })
+    {
+        const auto [words, status] = server.MatchDocument(phrase_query, document_id);
+        ASSERT_EQUAL(words.size(), document_id == 1 ? 2u : 0u);
+        ASSERT(get<0>(server.MatchDocument(execution::par, phrase_query, document_id)) == words);
+        ASSERT(get<0>(server.MatchDocument(thread_pool_policy, phrase_query, document_id)) == words);
+    }
+    ASSERT(get<0>(server.MatchDocument("\"quick fox\" brown"s, 4)).empty());
+    ASSERT_EQUAL(get<0>(server.MatchDocument("\"quick brown\"~1"s, 4)).size(), 2u);
+    ASSERT_THROWS(server.FindTopDocuments("\"quick brown\"~99999999999"s), invalid_argument);
+    ASSERT_THROWS(server.FindTopDocuments("\"quick brown\"~1x"s), invalid_argument);
+    SearchServer no_positions(""s);
+    no_positions.AddDocument(1, "quick brown fox"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_THROWS(no_positions.MatchDocument(phrase_query, 1), invalid_argument);
+
+    server.RemoveDocument(1);
+    ASSERT(server.FindTopDocuments("\"quick brown\""s).empty());
+    ASSERT_THROWS(server.FindTopDocuments("\"quick brown"s), invalid_argument);
+    ASSERT_THROWS(SearchServer(""s).FindTopDocuments("\"quick brown\""s), invalid_argument);
+}
+
+void TestTermDictionary()
+{
+    mt19937 generator;
+    const auto words = GenerateDictionary(generator, 1000, 8);
+    set<string> sorted_words(words.begin(), words.end());
+    const vector<string_view> terms(sorted_words.begin(), sorted_words.end());
+    auto find_by_prefix = [](const TermDictionary& dictionary, string_view prefix, size_t max_count)
+    {
+        vector<string> found;
+        dictionary.VisitPrefix(prefix, max_count, [&](TermDictionary::TermId id, string_view term)
+            {
+                ASSERT_EQUAL(dictionary.GetTerm(id), term);
+                found.emplace_back(term);
+            });
+        return found;
+    };
+
+    const TermDictionary dictionary(terms);
+    ASSERT_EQUAL(dictionary.size(), terms.size());
+    // Ids follow the sorted order, and the dictionary takes less than a set of the terms would
+    size_t set_memory = 0;
+    for (size_t i = 0; i < terms.size(); ++i)
+    {
+        ASSERT(dictionary.Find(terms[i]) == optional<TermDictionary::TermId>(i));
+        ASSERT_EQUAL(dictionary.GetTerm(static_cast<TermDictionary::TermId>(i)), terms[i]);
+        set_memory += sizeof(string) + 4 * sizeof(void*) + (terms[i].size() > 15 ? terms[i].size() + 1 : 0);
+    }
+    ASSERT(!dictionary.Find(string(terms[0]) + "#"s));
+    ASSERT(dictionary.GetMemoryUsage() < set_memory);
+
+    const string prefix(terms[500].substr(0, 2));
+    vector<string> expected;
+    for (string_view term : terms)
+    {
+        if (term.substr(0, prefix.size()) == prefix)
+        {
+            expected.emplace_back(term);
+        }
+    }
+    ASSERT(find_by_prefix(dictionary, prefix, terms.size()) == expected);
+    ASSERT_EQUAL(find_by_prefix(dictionary, prefix, 1).size(), 1u);
+    ASSERT(find_by_prefix(dictionary, "~"s, 10).empty());
+
+    // Every other term is added later, and some are removed and added again
+    vector<string_view> even_terms;
+    for (size_t i = 0; i < terms.size(); i += 2)
+    {
+        even_terms.push_back(terms[i]);
+    }
+    TermDictionary changing(even_terms);
+    map<string_view, TermDictionary::TermId> model;
+    for (size_t i = 0; i < even_terms.size(); ++i)
+    {
+        model.emplace(even_terms[i], static_cast<TermDictionary::TermId>(i));
+    }
+    // Ids of removed terms are given out again, but never to two terms at once
+    auto add = [&](string_view term)
+    {
+        const TermDictionary::TermId id = changing.Add(term);
+        for (const auto& [_, model_id] : model)
+        {
+            ASSERT(model_id != id);
+        }
+        ASSERT(id < changing.GetIdBound());
+        model.emplace(term, id);
+    };
+    for (size_t i = 1; i < terms.size(); i += 2)
+    {
+        add(terms[i]);
+        if (i % 6 == 1)
+        {
+            changing.Remove(model.at(terms[i - 1]));
+            model.erase(terms[i - 1]);
+        }
+        if (i % 10 == 3)
+        {
+            changing.Remove(model.at(terms[i]));
+            model.erase(terms[i]);
+        }
+        if (i % 30 == 1)
+        {
+            add(terms[i - 1]);
+        }
+        if (i % 50 == 1)
+        {
+            ASSERT_EQUAL(changing.size(), model.size());
+            for (string_view term_prefix : { terms[i].substr(0, 1), terms[i].substr(0, 2), string_view() })
+            {
+                vector<string> model_terms;
+                for (auto it = model.lower_bound(term_prefix); it != model.end() && it->first.substr(0, term_prefix.size()) == term_prefix; ++it)
+                {
+                    model_terms.emplace_back(it->first);
+                }
+                ASSERT(find_by_prefix(changing, term_prefix, model.size()) == model_terms);
+            }
+        }
+    }
+    ASSERT(changing.GetIdBound() < terms.size());
+    for (string_view term : terms)
+    {
+        const auto it = model.find(term);
+        ASSERT(changing.Find(term) == (it == model.end() ? nullopt : optional<TermDictionary::TermId>(it->second)));
+    }
+}
+
+void TestStopWordSetAndTermFilter()
+{
+    mt19937 generator;
+    const auto words = GenerateDictionary(generator, 2000, 8);
+    const set<string, less<>> stop_words(words.begin(), words.begin() + 1000);
+    const StopWordSet stop_word_set(stop_words);
+    ASSERT_EQUAL(stop_word_set.size(), stop_words.size());
+    const set<string, less<>> slot_words(stop_word_set.begin(), stop_word_set.end());
+    ASSERT(slot_words == stop_words);
+    TermFilter term_filter(stop_words.size());
+    for (const string& word : stop_words)
+    {
+        ASSERT(stop_word_set.Contains(word));
+        term_filter.Add(word);
+    }
+    int false_positive_count = 0;
+    for (size_t i = 1000; i < words.size(); ++i)
+    {
+        if (stop_words.count(words[i]) == 0)
+        {
+            ASSERT(!stop_word_set.Contains(words[i]));
+            false_positive_count += term_filter.MayContain(words[i]);
+        }
+    }
+    ASSERT(all_of(stop_words.begin(), stop_words.end(), [&term_filter](const string& word)
+        {
+            return term_filter.MayContain(word);
+        }));
+    ASSERT(false_positive_count < 20);
+    ASSERT(!StopWordSet().Contains("cat"s));
+    ASSERT(!TermFilter().MayContain("cat"s));
+
+    // The filter of a server grows with the dictionary and keeps removed words harmlessly
+    SearchServer server("and in"s);
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), words[i] + " and "s + words[(i + 1) % words.size()], DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT(server.FindTopDocuments("and"s).empty());
+    ASSERT(server.FindTopDocuments("in -dog"s).empty());
+    for (size_t i = 0; i < words.size(); i += 97)
+    {
+        ASSERT(server.GetWordDocumentCount(words[i]) > 0);
+        ASSERT(!server.FindTopDocuments(words[i]).empty());
+        ASSERT_EQUAL(get<0>(server.MatchDocument(execution::par, words[i], static_cast<int>(i))).size(), 1u);
+    }
+    const string removed_word = words[0] + "#"s;
+    server.AddDocument(5000, removed_word, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.GetWordDocumentCount(removed_word), 1);
+    server.RemoveDocument(5000);
+    ASSERT_EQUAL(server.GetWordDocumentCount(removed_word), 0);
+    ASSERT(server.FindTopDocuments(removed_word).empty());
+    server.Compact();
+    ASSERT_EQUAL(server.GetWordDocumentCount(removed_word), 0);
+    ASSERT(server.GetWordDocumentCount(words[1]) > 0);
+    ASSERT(server.GetIndexMemoryUsage().term_filter_bytes > 0u);
+}
+
+void TestPrefixQueries()
+{
+    SearchServer server("cat"s);
+    server.AddDocument(1, "catalog of things"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "category theory"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, { 3 });
+    ASSERT_EQUAL(server.FindTopDocuments("cat*"s).size(), 2u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat* -theor*"s).size(), 1u);
+    const auto [words, status] = server.MatchDocument("categ* things"s, 2);
+    ASSERT_EQUAL(words.size(), 1u);
+    ASSERT_EQUAL(words[0], "category"s);
+
+    server.AddDocument(4, "catapult"s, DocumentStatus::ACTUAL, { 4 });
+    ASSERT_EQUAL(server.FindTopDocuments("cat*"s).size(), 3u);
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(server.FindTopDocuments("cat*"s).size(), 2u);
+
+    const int max_expansion_count = MAX_PREFIX_EXPANSION_COUNT;
+    MAX_PREFIX_EXPANSION_COUNT = 1;
+    ASSERT_EQUAL(server.FindTopDocuments("cat*"s).size(), 1u);
+    MAX_PREFIX_EXPANSION_COUNT = max_expansion_count;
+    ASSERT_THROWS(server.FindTopDocuments("*"s), invalid_argument);
+}
+
+void TestLoadDocuments()
+{
+    const auto documents = MakeCorpus(500);
+    const string path = "/tmp/search_server_test_"s + to_string(getpid()) + ".tsv"s;
+    {
+        ofstream out(path);
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+            out << i << "\t"s << (i % 2 ? "ACTUAL"s : "BANNED"s) << "\t"s << i % 7 << ' ' << 1 << "\t"s << documents[i] << "\r\n"s;
+        }
+        out << "\n"s << "x\tACTUAL\t1\tcat\n"s << "1000\tUNKNOWN\t1\tcat\n"s << "1001\tACTUAL\t1 y\tcat\n"s;
+        out << "0\tACTUAL\t\tduplicate\n"s << "1002\tACTUAL\t\tlast line without newline"s;
+    }
+    SearchServer loaded(""s);
+    // Tiny batches and queue make parsers wait for the indexer
+    const LoadStatistics statistics = LoadDocuments(loaded, path, { 3, 64, 1 });
+    ASSERT_EQUAL(statistics.document_count, documents.size() + 1);
+    ASSERT_EQUAL(statistics.rejected_line_count, 4u);
+
+    SearchServer single(""s);
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        single.AddDocument(static_cast<int>(i), documents[i], i % 2 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED,
+            { static_cast<int>(i % 7), 1 });
+    }
+    single.AddDocument(1002, "last line without newline"s, DocumentStatus::ACTUAL, {});
+    for (int i = 0; i < 30; ++i)
+    {
+        AssertSameDocuments(single.FindTopDocuments(documents[i]), loaded.FindTopDocuments(documents[i]));
+        AssertSameDocuments(single.FindTopDocuments(documents[i], DocumentStatus::BANNED),
+            loaded.FindTopDocuments(documents[i], DocumentStatus::BANNED));
+    }
+    ASSERT_EQUAL(loaded.FindTopDocuments("newline"s).size(), 1u);
+
+    SearchServer pool_loaded(""s);
+    pool_loaded.SetThreadPoolOptions({ 3 });
+    LoadOptions pool_options{ 1, 64, 1 };
+    pool_options.use_thread_pool = true;
+    ASSERT_EQUAL(LoadDocuments(pool_loaded, path, pool_options).document_count, statistics.document_count);
+    AssertSameDocuments(loaded.FindTopDocuments(documents[0]), pool_loaded.FindTopDocuments(documents[0]));
+    remove(path.c_str());
+    ASSERT_THROWS(LoadDocuments(loaded, path), system_error);
+}
+
+void TestLoadDocumentsInFileOrder()
+{
+    const string path = "/tmp/search_server_test_order_"s + to_string(getpid()) + ".tsv"s;
+    const int document_count = 200;
+    {
+        ofstream out(path);
+        for (const string& text : { "first"s, "second"s })
+        {
+            for (int id = 0; id < document_count; ++id)
+            {
+                out << id << "\tACTUAL\t1\t"s << text << "\n"s;
+            }
+        }
+    }
+    for (bool use_thread_pool : { false, true })
+    {
+        SearchServer loaded(""s);
+        loaded.SetThreadPoolOptions({ 4 });
+        // A batch per line or two, parsed by more threads than the queue holds
+        LoadOptions options{ 4, 16, 2 };
+        options.use_thread_pool = use_thread_pool;
+        const LoadStatistics statistics = LoadDocuments(loaded, path, options);
+        ASSERT_EQUAL(statistics.document_count, static_cast<size_t>(document_count));
+        ASSERT_EQUAL(statistics.rejected_line_count, static_cast<size_t>(document_count));
+        // The earlier line of a duplicate id is indexed, the later one rejected
+        for (int id = 0; id < document_count; ++id)
+        {
+            const auto [words, status] = loaded.MatchDocument("first"s, id);
+            ASSERT_EQUAL(words.size(), 1u);
+        }
+    }
+    remove(path.c_str());
+}
+
+void TestWriteAheadLogRecovery()
+{
+    const auto documents = MakeCorpus(500);
+    char directory_template[] = "/tmp/search_server_test_XXXXXX";
+    const string directory = mkdtemp(directory_template);
+    SearchServer single(""s);
+    {
+        DurableSearchServer durable(directory, ""s);
+        // Concurrent writers share syncs
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer)
+        {
+            writers.emplace_back([&durable, &documents, writer]
+                {
+                    for (int i = writer; i < 400; i += 4)
+                    {
+                        durable.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { i % 5 });
+                    }
+                });
+        }
+        for (auto& writer : writers)
+        {
+            writer.join();
+        }
+        for (int i = 0; i < 50; ++i)
+        {
+            durable.RemoveDocument(i);
+        }
+        for (int i = 0; i < 10; ++i)
+        {
+            durable.AddDocument(i, documents[i], DocumentStatus::BANNED, { 7, 8 });
+        }
+        ASSERT_THROWS(durable.AddDocument(100, "duplicate"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+        ASSERT_EQUAL(durable.GetLogStatistics().record_count, 460u);
+        ASSERT(durable.GetLogStatistics().sync_count <= 460u);
+
+        durable.Checkpoint();
+        for (int i = 400; i < 500; ++i)
+        {
+            durable.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { i % 5 });
+        }
+        for (int i = 100; i < 110; ++i)
+        {
+            durable.RemoveDocument(i);
+        }
+        durable.RemoveDocument(100);
+        ASSERT_EQUAL(durable.GetLogStatistics().record_count, 110u);
+    }
+    for (int i = 0; i < 500; ++i)
+    {
+        if (i < 10)
+        {
+            single.AddDocument(i, documents[i], DocumentStatus::BANNED, { 7, 8 });
+        }
+        else if (i >= 50 && (i < 100 || i >= 110))
+        {
+            single.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { i % 5 });
+        }
+    }
+
+    // A crash in the middle of an append leaves a torn record
+    {
+        ofstream log(directory + "/current.wal"s, ios::binary | ios::app);
+        log << "torn"s;
+    }
+    {
+        DurableSearchServer recovered(directory, ""s);
+        const RecoveryStatistics& statistics = recovered.GetRecoveryStatistics();
+        ASSERT_EQUAL(statistics.snapshot_record_count, 360u);
+        ASSERT_EQUAL(statistics.log_record_count, 110u);
+        ASSERT_EQUAL(statistics.document_count, 450u);
+        ASSERT_EQUAL(statistics.discarded_byte_count, 4u);
+        ASSERT_EQUAL(recovered.GetDocumentCount(), single.GetDocumentCount());
+        for (int i = 0; i < 40; ++i)
+        {
+            AssertSameDocuments(single.FindTopDocuments(documents[i]), recovered.FindTopDocuments(documents[i]));
+            AssertSameDocuments(single.FindTopDocuments(documents[i], DocumentStatus::BANNED),
+                recovered.FindTopDocuments(documents[i], DocumentStatus::BANNED));
+        }
+        recovered.AddDocument(1000, "appended after recovery"s, DocumentStatus::ACTUAL, {});
+    }
+    {
+        DurableSearchServer recovered(directory, ""s);
+        ASSERT_EQUAL(recovered.GetRecoveryStatistics().discarded_byte_count, 0u);
+        ASSERT_EQUAL(recovered.GetDocumentCount(), single.GetDocumentCount() + 1);
+        ASSERT_EQUAL(recovered.FindTopDocuments("recovery"s).size(), 1u);
+    }
+    filesystem::remove_all(directory);
+}
+
+void TestCheckpointWhileWriting()
+{
+    const auto documents = MakeCorpus(400);
+    char directory_template[] = "/tmp/search_server_test_XXXXXX";
+    const string directory = mkdtemp(directory_template);
+    {
+        DurableSearchServer durable(directory, ""s);
+        atomic<bool> is_checkpointing = true;
+        thread checkpointer([&durable, &is_checkpointing]
+            {
+                while (is_checkpointing)
+                {
+                    durable.Checkpoint();
+                }
+            });
+        thread reader([&durable, &documents, &is_checkpointing]
+            {
+                while (is_checkpointing)
+                {
+                    durable.FindTopDocuments(documents[0]);
+                }
+            });
+        for (int i = 0; i < 300; ++i)
+        {
+            durable.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { i % 5 });
+            if (i % 3 == 0)
+            {
+                durable.RemoveDocument(i / 2);
+            }
+        }
+        is_checkpointing = false;
+        checkpointer.join();
+        reader.join();
+    }
+    SearchServer single(""s);
+    for (int i = 0; i < 300; ++i)
+    {
+        single.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { i % 5 });
+        if (i % 3 == 0)
+        {
+            single.RemoveDocument(i / 2);
+        }
+    }
+    auto assert_recovered = [&]
+    {
+        DurableSearchServer recovered(directory, ""s);
+        ASSERT_EQUAL(recovered.GetDocumentCount(), single.GetDocumentCount());
+        for (int i = 0; i < 20; ++i)
+        {
+            AssertSameDocuments(single.FindTopDocuments(documents[i]), recovered.FindTopDocuments(documents[i]));
+        }
+    };
+    assert_recovered();
+
+    // A crash right after a checkpoint froze the log leaves the frozen log behind
+    filesystem::rename(directory + "/current.wal"s, directory + "/frozen.wal"s);
+    {
+        DurableSearchServer recovered(directory, ""s);
+        recovered.AddDocument(1000, documents[300], DocumentStatus::ACTUAL, {});
+        recovered.RemoveDocument(1000);
+        recovered.Checkpoint();
+    }
+    ASSERT(!filesystem::exists(directory + "/frozen.wal"s));
+    assert_recovered();
+    filesystem::remove_all(directory);
+}
+
+void TestWriteAheadLogFailure()
+{
+    char directory_template[] = "/tmp/search_server_test_XXXXXX";
+    const string directory = mkdtemp(directory_template);
+    {
+        DurableSearchServer durable(directory, ""s);
+        durable.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_THROWS(durable.AddDocument(2, "bad\x01word"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+        ASSERT_EQUAL(durable.GetLogStatistics().record_count, 1u);
+
+        // No write may grow the log past its current size
+        rlimit file_size_limit;
+        getrlimit(RLIMIT_FSIZE, &file_size_limit);
+        const rlimit failing_limit{ static_cast<rlim_t>(filesystem::file_size(directory + "/current.wal"s)), file_size_limit.rlim_max };
+        const auto file_size_handler = signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &failing_limit);
+        bool has_failed = false;
+        try
+        {
+            durable.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+        }
+        catch (const system_error&)
+        {
+            has_failed = true;
+        }
+        setrlimit(RLIMIT_FSIZE, &file_size_limit);
+        signal(SIGXFSZ, file_size_handler);
+        ASSERT(has_failed);
+
+        // The change that was never logged is not applied, and the broken log refuses later ones
+        ASSERT_EQUAL(durable.GetDocumentCount(), 1);
+        ASSERT(durable.FindTopDocuments("dog"s).empty());
+        ASSERT_THROWS(durable.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 }), system_error);
+        ASSERT_THROWS(durable.RemoveDocument(1), system_error);
+        ASSERT_EQUAL(durable.FindTopDocuments("cat"s).size(), 1u);
+    }
+    {
+        DurableSearchServer recovered(directory, ""s);
+        ASSERT_EQUAL(recovered.GetDocumentCount(), 1);
+        ASSERT_EQUAL(recovered.FindTopDocuments("cat"s).size(), 1u);
+        recovered.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+        ASSERT_EQUAL(recovered.FindTopDocuments("dog"s).size(), 1u);
+    }
+    filesystem::remove_all(directory);
+}
+
+void TestIndexMemoryUsage()
+{
+    const auto documents = MakeCorpus(200);
+    SearchServer server(""s);
+    server.EnablePositionalIndex();
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+    }
+    const IndexMemoryUsage usage = server.GetIndexMemoryUsage();
+    ASSERT(usage.dictionary_bytes > 0);
+    ASSERT(usage.posting_bytes > usage.dictionary_bytes);
+    ASSERT(usage.forward_index_bytes > 0);
+    ASSERT(usage.position_bytes > 0);
+    ASSERT(usage.document_bytes > 0);
+    ASSERT(usage.reserved_bytes >= usage.dictionary_bytes + usage.posting_bytes + usage.forward_index_bytes);
+    ASSERT_EQUAL(usage.document_count, documents.size());
+    size_t posting_count = 0;
+    for (int document_id : server)
+    {
+        posting_count += server.GetWordFrequencies(document_id).size();
+    }
+    ASSERT_EQUAL(usage.posting_count, posting_count);
+    ASSERT(abs(usage.GetAveragePostingLength() - static_cast<double>(posting_count) / usage.term_count) < EPSILON);
+
+    // Heavy churn leaves free blocks in the pool until the index is compacted
+    for (size_t i = 10; i < documents.size(); ++i)
+    {
+        server.RemoveDocument(execution::par, static_cast<int>(i));
+    }
+    vector<vector<Document>> expected;
+    for (int i = 0; i < 10; ++i)
+    {
+        expected.push_back(server.FindTopDocuments(documents[i]));
+    }
+    const IndexMemoryUsage churned_usage = server.GetIndexMemoryUsage();
+    server.Compact();
+    const IndexMemoryUsage compacted_usage = server.GetIndexMemoryUsage();
+    ASSERT(compacted_usage.reserved_bytes < churned_usage.reserved_bytes);
+    ASSERT(compacted_usage.dictionary_bytes <= churned_usage.dictionary_bytes);
+    ASSERT_EQUAL(compacted_usage.posting_count, churned_usage.posting_count);
+    for (int i = 0; i < 10; ++i)
+    {
+        AssertSameDocuments(expected[i], server.FindTopDocuments(documents[i]));
+    }
+    const string phrase = "\""s + string(SplitIntoWordsView(documents[0])[0]) + " "s + string(SplitIntoWordsView(documents[0])[1]) + "\""s;
+    ASSERT(!server.FindTopDocuments(phrase).empty());
+
+    server.AddDocument(1000, documents[20], DocumentStatus::ACTUAL, { 1 });
+    for (int i = 0; i < 10; ++i)
+    {
+        server.RemoveDocument(i);
+    }
+    server.RemoveDocument(1000);
+    const IndexMemoryUsage empty_usage = server.GetIndexMemoryUsage();
+    ASSERT_EQUAL(empty_usage.dictionary_bytes, 0u);
+    ASSERT_EQUAL(empty_usage.posting_bytes, 0u);
+    ASSERT_EQUAL(empty_usage.position_bytes, 0u);
+    ASSERT_EQUAL(empty_usage.forward_index_bytes, 0u);
+    ASSERT_EQUAL(empty_usage.term_count, 0u);
+}
+
+void TestShardedServerMatchesSingleServer()
+{
+    const auto documents = MakeCorpus(600);
+    SearchServer single(""s);
+    ShardedSearchServer sharded(4, ""s);
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        single.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 5) });
+        sharded.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 5) });
+    }
+    for (int i = 0; i < 50; ++i)
+    {
+        const string& query = documents[i];
+        AssertSameDocuments(single.FindTopDocuments(query), sharded.FindTopDocuments(query));
+    }
+}
+
+void TestShardedServerGlobalInverseDocumentFreq()
+{
+    // One document per shard, so every shard alone would see a different IDF
+    ShardedSearchServer sharded(4, "and"s);
+    sharded.AddDocument(0, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    sharded.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 2 });
+    sharded.AddDocument(2, "bird"s, DocumentStatus::ACTUAL, { 3 });
+    sharded.AddDocument(3, "cat bird"s, DocumentStatus::ACTUAL, { 4 });
+    auto documents = sharded.FindTopDocuments("cat cat and -dog"s);
+    ASSERT_EQUAL(documents.size(), 2u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    ASSERT(abs(documents[0].relevance - log(4.0 / 3.0)) < EPSILON);
+    ASSERT(abs(documents[1].relevance - 0.5 * log(4.0 / 3.0)) < EPSILON);
+
+    sharded.RemoveDocument(3);
+    documents = sharded.FindTopDocuments("bird cat"s);
+    ASSERT_EQUAL(documents.size(), 3u);
+    ASSERT_EQUAL(documents[0].id, 2);
+    ASSERT(abs(documents[0].relevance - log(3.0)) < EPSILON);
+    ASSERT(abs(documents[1].relevance - log(1.5)) < EPSILON);
+    ASSERT_THROWS(sharded.FindTopDocuments("cat --dog"s), invalid_argument);
+}
+
+void TestShardCoordinatorMatchesSingleServer()
+{
+    const auto documents = MakeCorpus(300);
+    vector<string> socket_paths;
+    vector<unique_ptr<ShardProcess>> shards;
+    for (int i = 0; i < 3; ++i)
+    {
+        socket_paths.push_back("/tmp/search_server_test_"s + to_string(getpid()) + "_"s + to_string(i) + ".sock"s);
+        shards.push_back(make_unique<ShardProcess>(SEARCH_SERVER_SHARD_EXECUTABLE, socket_paths.back(), ""s));
+    }
+    ShardCoordinator coordinator(socket_paths, chrono::seconds(5));
+    SearchServer single(""s);
+    vector<RemoteDocument> remote_documents;
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        single.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+        remote_documents.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 } });
+    }
+    coordinator.AddDocuments(remote_documents);
+    for (int i = 0; i < 30; ++i)
+    {
+        const auto result = coordinator.FindTopDocuments(documents[i]);
+        ASSERT(!result.IsPartial());
+        AssertSameDocuments(single.FindTopDocuments(documents[i]), result.documents);
+    }
+    ASSERT_THROWS(coordinator.AddDocument(0, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+}
+
+void TestShardedPrefixQueries()
+{
+    const vector<string> documents = { "cat dog"s, "cats and dogs"s, "catalog of birds"s, "cat"s, "dog"s,
+        "category cat"s, "bird cat"s, "dog house"s, "caterpillar"s };
+    const string socket_path_prefix = "/tmp/search_server_test_"s + to_string(getpid()) + "_prefix_"s;
+    vector<string> socket_paths;
+    vector<unique_ptr<ShardProcess>> shards;
+    for (int i = 0; i < 3; ++i)
+    {
+        socket_paths.push_back(socket_path_prefix + to_string(i) + ".sock"s);
+        shards.push_back(make_unique<ShardProcess>(SEARCH_SERVER_SHARD_EXECUTABLE, socket_paths.back(), "and of"s));
+    }
+    ShardCoordinator coordinator(socket_paths, chrono::seconds(5));
+    ShardedSearchServer sharded(3, "and of"s);
+    SearchServer single("and of"s);
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        const int id = static_cast<int>(i);
+        single.AddDocument(id, documents[i], DocumentStatus::ACTUAL, { id });
+        sharded.AddDocument(id, documents[i], DocumentStatus::ACTUAL, { id });
+        coordinator.AddDocument(id, documents[i], DocumentStatus::ACTUAL, { id });
+    }
+
+    const int max_prefix_expansion_count = MAX_PREFIX_EXPANSION_COUNT;
+    for (int expansion_count : { max_prefix_expansion_count, 2 })
+    {
+        // Every shard has fewer words than the cut, the merged expansion is cut nonetheless
+        MAX_PREFIX_EXPANSION_COUNT = expansion_count;
+        for (const string& query : { "cat*"s, "cat* dog"s, "-cat* dog"s, "cat* -dog"s, "cata* bird"s, "x* cat"s })
+        {
+            const auto expected = single.FindTopDocuments(query);
+            AssertSameDocuments(expected, sharded.FindTopDocuments(query));
+            const auto result = coordinator.FindTopDocuments(query);
+            ASSERT(!result.IsPartial());
+            AssertSameDocuments(expected, result.documents);
+        }
+    }
+    MAX_PREFIX_EXPANSION_COUNT = max_prefix_expansion_count;
+
+    const auto [words, status] = coordinator.MatchDocument("cat* -dog"s, 5);
+    ASSERT((words == vector<string>{ "cat"s, "category"s }));
+    ASSERT_EQUAL(static_cast<int>(status), static_cast<int>(DocumentStatus::ACTUAL));
+    ASSERT(get<0>(coordinator.MatchDocument("cat* -dog"s, 0)).empty());
+    ASSERT_THROWS(coordinator.FindTopDocuments("\"cat* dog\""s), invalid_argument);
+}
+
+void TestShardCoordinatorUnavailableShards()
+{
+    const string socket_path_prefix = "/tmp/search_server_test_"s + to_string(getpid()) + "_unavailable_"s;
+    const string stalled_path = socket_path_prefix + "stalled.sock"s;
+    const string restarted_path = socket_path_prefix + "restarted.sock"s;
+    // Connections to the stalled shard wait in the backlog, nothing is ever read from them
+    const int stalled_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, stalled_path.c_str());
+    unlink(stalled_path.c_str());
+    ASSERT_EQUAL(bind(stalled_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQUAL(listen(stalled_fd, 16), 0);
+    auto restarted = make_unique<ShardProcess>(SEARCH_SERVER_SHARD_EXECUTABLE, restarted_path, ""s);
+    ShardCoordinator coordinator({ stalled_path, restarted_path }, chrono::milliseconds(200));
+
+    // A document larger than the socket buffers must not block past the timeout
+    string large_document;
+    for (int i = 0; i < 400000; ++i)
+    {
+        large_document += "word "s;
+    }
+    const auto start = chrono::steady_clock::now();
+    ASSERT_THROWS(coordinator.AddDocument(0, large_document, DocumentStatus::ACTUAL, { 1 }), runtime_error);
+    ASSERT(chrono::steady_clock::now() - start < chrono::seconds(2));
+    coordinator.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    auto result = coordinator.FindTopDocuments("cat"s);
+    ASSERT(result.IsPartial());
+    ASSERT_EQUAL(result.answered_shard_count, 1u);
+    ASSERT_EQUAL(result.documents.size(), 1u);
+
+    restarted.reset();
+    ASSERT_EQUAL(coordinator.FindTopDocuments("cat"s).answered_shard_count, 0u);
+    ASSERT_EQUAL(coordinator.FindTopDocuments("cat"s).answered_shard_count, 0u);
+    restarted = make_unique<ShardProcess>(SEARCH_SERVER_SHARD_EXECUTABLE, restarted_path, ""s);
+    coordinator.AddDocument(3, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    result = coordinator.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(result.answered_shard_count, 1u);
+    ASSERT_EQUAL(result.documents.size(), 1u);
+    ASSERT_EQUAL(result.documents[0].id, 3);
+    close(stalled_fd);
+    unlink(stalled_path.c_str());
+}
+
+void TestShardProcessFromThreadedOwner()
+{
+    // The owner runs pool threads when the shard is started
+    SearchServer single("and"s);
+    ThreadPoolOptions options;
+    options.thread_count = 4;
+    single.SetThreadPoolOptions(options);
+    single.GetThreadPool();
+    const string socket_path = "/tmp/search_server_test_"s + to_string(getpid()) + "_threaded.sock"s;
+    pid_t pid = -1;
+    {
+        ShardProcess shard(SEARCH_SERVER_SHARD_EXECUTABLE, socket_path, "and"s);
+        pid = shard.GetPid();
+        ShardCoordinator coordinator({ socket_path }, chrono::seconds(5));
+        const vector<string> documents = { "cat and dog"s, "cat"s, "bird"s, "cat bird"s };
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+            single.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+            coordinator.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1 });
+        }
+        // A word repeated in the query counts once in its document frequency
+        for (const string& query : { "cat cat bird"s, "bird bird -dog"s })
+        {
+            const auto result = coordinator.FindTopDocuments(query);
+            ASSERT(!result.IsPartial());
+            AssertSameDocuments(single.FindTopDocuments(query), result.documents);
+        }
+    }
+    ASSERT_EQUAL(kill(pid, 0), -1);
+    ASSERT_EQUAL(access(socket_path.c_str(), F_OK), -1);
+    ASSERT_THROWS(ShardProcess("/nonexistent/search_server_shard"s, socket_path, ""s), runtime_error);
+}
+
+int main()
+{
+    RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
+    RUN_TEST(TestMinusWordsExcludeDocuments);
+    RUN_TEST(TestRelevanceIsTfIdf);
+    RUN_TEST(TestBm25Scorer);
+    RUN_TEST(TestStatusAndPredicateFilters);
+    RUN_TEST(TestPredicateFastPaths);
+    RUN_TEST(TestParallelQueryRanges);
+    RUN_TEST(TestParallelQueryRangesSkewedIds);
+    RUN_TEST(TestFacets);
+    RUN_TEST(TestResultCursor);
+    RUN_TEST(TestRequestStatistics);
+    RUN_TEST(TestThreadPool);
+    RUN_TEST(TestMatchAndRemoveDocument);
+    RUN_TEST(TestInvalidInputThrows);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestStopWordSetAndTermFilter);
+    RUN_TEST(TestPrefixQueries);
+    RUN_TEST(TestLoadDocuments);
+    RUN_TEST(TestLoadDocumentsInFileOrder);
+    RUN_TEST(TestWriteAheadLogRecovery);
+    RUN_TEST(TestWriteAheadLogFailure);
+    RUN_TEST(TestCheckpointWhileWriting);
+    RUN_TEST(TestIndexMemoryUsage);
+    RUN_TEST(TestShardedServerMatchesSingleServer);
+    RUN_TEST(TestShardedServerGlobalInverseDocumentFreq);
+    RUN_TEST(TestShardCoordinatorMatchesSingleServer);
+    RUN_TEST(TestShardProcessFromThreadedOwner);
+    RUN_TEST(TestShardCoordinatorUnavailableShards);
+    RUN_TEST(TestShardedPrefixQueries);
+    cerr << "All tests passed"s << endl;
+}